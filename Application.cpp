@@ -5,7 +5,12 @@
 #include "classes/Othello.h"
 #include "classes/Connect4.h"
 #include "classes/Chess.h"
-#include <random>
+#include "classes/Trace.h"
+#include "classes/AllocTracker.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
 
 namespace ClassGame {
     //
@@ -23,11 +28,137 @@ namespace ClassGame {
         game = nullptr;
     }
 
+    //
+    // the analysis panel's contents, from the latest snapshot the search published
+    //
+    static void RenderAnalysis(Chess& chess) {
+        AnalysisChannel& analysis = chess.analysis();
+        analysis.update();
+        const AnalysisSnapshot& snapshot = analysis.front();
+
+        ImGui::Text("Search: %s", chess.searchStatus().c_str());
+        if (snapshot.rowCount == 0) {
+            return;
+        }
+        const AnalysisRow& last = snapshot.rows[snapshot.rowCount - 1];
+        ImGui::Text("Nodes: %llu  NPS: %llu  Hash: %.1f%%", (unsigned long long)last.nodes,
+                    (unsigned long long)(last.nodes * 1000 / std::max<int64_t>(1, last.time)), last.hashfull / 10.0f);
+        ImGui::Separator();
+
+        const SearchStats& stats = snapshot.stats;
+        if (SEARCH_STATS && ImGui::CollapsingHeader("Statistics")) {
+            const auto percent = [](const uint64_t part, const uint64_t whole) {
+                return whole > 0 ? 100.0f * part / whole : 0.0f;
+            };
+            ImGui::Text("Quiescence nodes: %.1f%%", percent(stats.qnodes, stats.nodes));
+            ImGui::Text("TT hits: %.1f%%  cutoffs: %.1f%% of probes", percent(stats.ttHits, stats.ttProbes),
+                        percent(stats.ttCutoffs, stats.ttProbes));
+            ImGui::Text("Beta cutoffs: %llu, by move index:", (unsigned long long)stats.betaCutoffs);
+            for (int index = 0; index < CUTOFF_INDEX_SLOTS; index++) {
+                ImGui::SameLine();
+                ImGui::Text("%s%d %.0f%%", index == CUTOFF_INDEX_SLOTS - 1 ? ">=" : "", index + 1,
+                            percent(stats.cutoffsByMoveIndex[index], stats.betaCutoffs));
+            }
+            ImGui::Text("Null move cutoffs: %.1f%% of %llu", percent(stats.nullMoveCutoffs, stats.nullMoveTries),
+                        (unsigned long long)stats.nullMoveTries);
+            // a reduction holds when the reduced search doesn't have to be repeated
+            ImGui::Text("LMR held: %.1f%% of %llu", 100.0f - percent(stats.lmrReSearches, stats.lmrReductions),
+                        (unsigned long long)stats.lmrReductions);
+            ImGui::Separator();
+        }
+
+        const ImGuiTableFlags flags = ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV | ImGuiTableFlags_ScrollY;
+        if (!ImGui::BeginTable("iterations", 9, flags)) {
+            return;
+        }
+        ImGui::TableSetupScrollFreeze(0, 1);
+        ImGui::TableSetupColumn("depth");
+        ImGui::TableSetupColumn("seldepth");
+        ImGui::TableSetupColumn("score");
+        ImGui::TableSetupColumn("nodes");
+        ImGui::TableSetupColumn("nps");
+        ImGui::TableSetupColumn("hashfull");
+        ImGui::TableSetupColumn("time");
+        ImGui::TableSetupColumn("ebf");
+        ImGui::TableSetupColumn("pv", ImGuiTableColumnFlags_WidthStretch);
+        ImGui::TableHeadersRow();
+
+        // deepest first, the line the AI will play on top
+        for (int index = snapshot.rowCount - 1; index >= 0; index--) {
+            const AnalysisRow& row = snapshot.rows[index];
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Text("%d", row.depth);
+            ImGui::TableNextColumn();
+            ImGui::Text("%d", row.selDepth);
+            ImGui::TableNextColumn();
+            if (std::abs(row.score) >= SCORE_MATE_BOUND) {
+                // in moves, negative when the AI is being mated
+                const int plies = SCORE_MATE - std::abs(row.score);
+                ImGui::Text("#%d", row.score > 0 ? (plies + 1) / 2 : -(plies / 2));
+            }
+            else {
+                ImGui::Text("%+.2f", row.score / 100.0f);
+            }
+            ImGui::TableNextColumn();
+            ImGui::Text("%llu", (unsigned long long)row.nodes);
+            ImGui::TableNextColumn();
+            ImGui::Text("%llu", (unsigned long long)(row.nodes * 1000 / std::max<int64_t>(1, row.time)));
+            ImGui::TableNextColumn();
+            ImGui::Text("%d", row.hashfull);
+            ImGui::TableNextColumn();
+            ImGui::Text("%lld", (long long)row.time);
+            ImGui::TableNextColumn();
+            // rows are the main thread's iterations, the first searched to depth 1
+            ImGui::Text("%.2f", stats.branchingFactor(row.depth - 1));
+            ImGui::TableNextColumn();
+            std::string pv;
+            for (int ply = 0; ply < row.pvLength; ply++) {
+                pv += GameState::moveToUci(row.pv[ply]) + " ";
+            }
+            ImGui::TextUnformatted(pv.c_str());
+        }
+        ImGui::EndTable();
+    }
+
+#ifdef CHESS_ALLOC_TRACKING
+    //
+    // allocations per frame, the last frame by tag and the history as a graph; it allocates nothing itself
+    //
+    static void RenderAllocations() {
+        const AllocCounts& frame = allocHistory(0);
+        ImGui::Text("This frame: %llu allocations, %llu bytes, %llu frees", (unsigned long long)frame.totalCount(),
+                    (unsigned long long)frame.totalBytes(), (unsigned long long)frame.frees);
+        for (int tag = 0; tag < AllocTagCount; tag++) {
+            ImGui::Text("%-8s %6llu  %8llu bytes", ALLOC_TAG_NAMES[tag], (unsigned long long)frame.count[tag],
+                        (unsigned long long)frame.bytes[tag]);
+        }
+
+        // oldest on the left
+        const auto allocations = [](void*, const int index) {
+            return static_cast<float>(allocHistory(ALLOC_HISTORY_FRAMES - 1 - index).totalCount());
+        };
+        uint64_t peak = 0;
+        for (int age = 0; age < ALLOC_HISTORY_FRAMES; age++) {
+            peak = std::max(peak, allocHistory(age).totalCount());
+        }
+        char overlay[32];
+        snprintf(overlay, sizeof(overlay), "peak %llu", (unsigned long long)peak);
+        ImGui::PlotHistogram("##allocations", allocations, nullptr, ALLOC_HISTORY_FRAMES, 0, overlay, 0.0f,
+                             static_cast<float>(std::max<uint64_t>(peak, 1)), ImVec2(-1, 80));
+    }
+#endif
+
     //
     // game render loop
     // this is called by the main render loop in main.cpp
     //
     void RenderGame() {
+        TRACE_SCOPE("RenderGame");
+        TRACE_THREAD_NAME("ui");
+        // a frame runs from one call to the next, rendering and presenting included
+        allocFrame();
+        ALLOC_TAG(AllocUI);
         ImGui::DockSpaceOverViewport();
 
         //ImGui::ShowDemoWindow();
@@ -73,10 +204,19 @@ namespace ClassGame {
             int         height      = game->_gameOptions.rowY;
 
             for (int y = 0; y < height; y++) {
-                ImGui::Text("%s", stateString.substr(y * stride, stride).c_str());
+                ImGui::Text("%.*s", stride, stateString.c_str() + y * stride);
             }
-            ImGui::Text("Current Board State: %s", game->stateString().c_str());
+            ImGui::Text("Current Board State: %s", stateString.c_str());
+            if (dynamic_cast<Chess*>(game)) {
+                ImGui::Checkbox("Use Opening Book", &game->_gameOptions.useOpeningBook);
+            }
+        }
+#ifdef CHESS_TRACE
+        // the last few seconds of every thread, for chrome://tracing or ui.perfetto.dev
+        if (ImGui::Button("Save Trace")) {
+            traceDump("chess-trace.json");
         }
+#endif
         ImGui::End();
 
         ImGui::Begin("GameWindow");
@@ -88,29 +228,29 @@ namespace ClassGame {
         }
         ImGui::End();
 
-        // ImGui::Begin("Possible Moves");
-        // if (auto* chess = dynamic_cast<Chess*>(game)) {
-        //     auto moves = chess->generateAllMoves();
-        //     if (moves.empty()) ImGui::BeginDisabled(true);
-        //     if (ImGui::Button("Play Random Move")) {
-        //         static std::random_device rd;
-        //         static std::mt19937 gen(rd());
-        //         std::uniform_int_distribution<> dis(0, moves.size() - 1);
-        //
-        //         chess->makeMove(moves[dis(gen)]);
-        //     }
-        //     if (moves.empty()) ImGui::EndDisabled();
-        //     ImGui::Text("There are %d possible moves", (uint32_t)(moves.size()));
-        //     ImGui::Separator();
-        //     for (const auto& move : moves) {
-        //         int fx = move.from % 8, fy = move.from / 8, tx = move.to % 8, ty = move.to / 8;
-        //         constexpr const char* pieceNames[] = {"", "pawn", "knight", "bishop", "rook", "queen", "king"};
-        //         constexpr char r[] = {'1','2','3','4','5','6','7','8'};
-        //         constexpr char f[] = {'a','b','c','d','e','f','g','h'};
-        //         ImGui::Text("%c%c -> %c%c ; %s", f[fx], r[fy], f[tx], r[ty], pieceNames[move.piece]);
-        //     }
-        // }
-        // ImGui::End();
+        // the AI's search as it goes, one row per iteration; the search only publishes while the panel is showing
+        if (auto* chess = dynamic_cast<Chess*>(game)) {
+            static bool showAnalysis = true;
+            bool        visible      = false;
+            if (showAnalysis) {
+                visible = ImGui::Begin("Analysis", &showAnalysis);
+                if (visible) {
+                    RenderAnalysis(*chess);
+                }
+                ImGui::End();
+            }
+            chess->setAnalysisEnabled(visible);
+        }
+
+#ifdef CHESS_ALLOC_TRACKING
+        static bool showAllocations = true;
+        if (showAllocations) {
+            if (ImGui::Begin("Allocations", &showAllocations)) {
+                RenderAllocations();
+            }
+            ImGui::End();
+        }
+#endif
     }
 
     //
@@ -0,0 +1,570 @@
+//
+// chess-book: builds a Polyglot opening book from local PGN files.
+//
+//   chess-book [--depth plies] [--min-games n] [--threads n] [--spill entries] [--tmp dir] -o book.bin games.pgn...
+//
+// Input files are cut into chunks that worker threads replay through GameState. Each worker counts
+// wins/draws/losses per (position, move) in its own hash map and spills it to a sorted run file when it
+// gets too big. The runs of all workers are then merged into one sorted book.
+//
+#include "classes/GameState.h"
+#include "classes/OpeningBook.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+static const char* START_STATE = "RNBQKBNRPPPPPPPP00000000000000000000000000000000pppppppprnbqkbnr";
+constexpr uint64_t CHUNK_BYTES = 64ULL << 20;
+
+struct BuilderOptions {
+    int                      depth    = 20; // plies of each game that go into the book
+    int                      minGames = 3;  // a move must have been played this often from the position
+    int                      threads  = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    size_t                   spill    = 4000000; // entries a worker holds in memory before writing a run
+    std::string              tmpDir   = ".";
+    std::string              output;
+    std::vector<std::string> inputs;
+};
+
+// counts are from the point of view of the side making the move
+struct MoveStats {
+    uint32_t wins   = 0;
+    uint32_t draws  = 0;
+    uint32_t losses = 0;
+};
+
+// one record of a sorted run file
+struct RunRecord {
+    uint64_t  key;
+    uint16_t  move;
+    MoveStats stats;
+};
+
+struct Chunk {
+    std::string path;
+    uint64_t    begin;
+    uint64_t    end;
+};
+
+static uint64_t mapKey(const uint64_t key, const uint16_t move) {
+    return key ^ (static_cast<uint64_t>(move) * 0x9E3779B97F4A7C15ULL);
+}
+
+struct PositionMove {
+    uint64_t key;
+    uint16_t move;
+    bool     operator==(const PositionMove& other) const { return key == other.key && move == other.move; }
+};
+
+struct PositionMoveHash {
+    size_t operator()(const PositionMove& value) const { return static_cast<size_t>(mapKey(value.key, value.move)); }
+};
+
+static bool recordLess(const RunRecord& a, const RunRecord& b) {
+    return a.key != b.key ? a.key < b.key : a.move < b.move;
+}
+
+//
+// SAN moves against the generator's legal moves. The generator has no castling, en passant or
+// promotion, so those are built here from the SAN and pushMove's flags.
+//
+static ChessPiece pieceFromLetter(const char letter) {
+    switch (letter) {
+    case 'N': return Knight;
+    case 'B': return Bishop;
+    case 'R': return Rook;
+    case 'Q': return Queen;
+    case 'K': return King;
+    default: return NoPiece;
+    }
+}
+
+static bool parseSan(GameState& state, std::string san, BitMove& move) {
+    while (!san.empty() && (san.back() == '+' || san.back() == '#' || san.back() == '!' || san.back() == '?')) {
+        san.pop_back();
+    }
+    if (san.empty()) {
+        return false;
+    }
+
+    const int homeRank = state.color == WHITE ? 0 : 56;
+    if (san == "O-O" || san == "0-0") {
+        move = BitMove(homeRank + 4, homeRank + 6, King, KingSideCastle);
+        return state.state[homeRank + 4] == (state.color == WHITE ? 'K' : 'k');
+    }
+    if (san == "O-O-O" || san == "0-0-0") {
+        move = BitMove(homeRank + 4, homeRank + 2, King, QueenSideCastle);
+        return state.state[homeRank + 4] == (state.color == WHITE ? 'K' : 'k');
+    }
+
+    ChessPiece piece = pieceFromLetter(san[0]);
+    size_t     pos   = piece == NoPiece ? 0 : 1;
+    if (piece == NoPiece) {
+        piece = Pawn;
+    }
+
+    bool promotion = false;
+    const size_t equals = san.find('=');
+    if (equals != std::string::npos) {
+        promotion = true;
+        san       = san.substr(0, equals);
+    }
+    else if (piece == Pawn && san.size() >= 2 && std::isupper(static_cast<unsigned char>(san.back()))) {
+        promotion = true; // "e8Q"
+        san.pop_back();
+    }
+
+    // the destination is the last two characters, anything between the piece and it disambiguates
+    if (san.size() < pos + 2) {
+        return false;
+    }
+    const char toFile = san[san.size() - 2];
+    const char toRank = san[san.size() - 1];
+    if (toFile < 'a' || toFile > 'h' || toRank < '1' || toRank > '8') {
+        return false;
+    }
+    const int to       = (toRank - '1') * 8 + (toFile - 'a');
+    int       fromFile = -1;
+    int       fromRank = -1;
+    bool      capture  = false;
+    for (size_t i = pos; i < san.size() - 2; i++) {
+        if (san[i] >= 'a' && san[i] <= 'h') {
+            fromFile = san[i] - 'a';
+        }
+        else if (san[i] >= '1' && san[i] <= '8') {
+            fromRank = san[i] - '1';
+        }
+        else if (san[i] == 'x') {
+            capture = true;
+        }
+    }
+
+    if (piece == Pawn && capture && state.state[to] == '0' && fromFile >= 0) {
+        const int from = to + (state.color == WHITE ? -8 : 8) + (fromFile - to % 8);
+        move           = BitMove(from, to, Pawn, EnPassant);
+        return true;
+    }
+
+    for (const BitMove& candidate : state.generateAllMoves()) {
+        if (candidate.piece != piece || candidate.to != to) {
+            continue;
+        }
+        if ((fromFile >= 0 && candidate.from % 8 != fromFile) || (fromRank >= 0 && candidate.from / 8 != fromRank)) {
+            continue;
+        }
+        move = candidate;
+        if (promotion || (piece == Pawn && (to < 8 || to >= 56))) {
+            move.flags |= IsPromotion;
+        }
+        return true;
+    }
+    return false;
+}
+
+//
+// worker
+//
+
+class BookWorker {
+public:
+    BookWorker(const BuilderOptions& options, const int id)
+        : _options(options)
+        , _id(id) { }
+
+    void processChunk(const Chunk& chunk);
+    void flush();
+
+    const std::vector<std::string>& runs() const { return _runs; }
+    uint64_t                        games() const { return _games; }
+
+private:
+    void replayGame(const std::string& movetext, int result);
+    void add(uint64_t key, uint16_t move, int result);
+    void spill();
+
+    const BuilderOptions&                                         _options;
+    const int                                                     _id;
+    std::unordered_map<PositionMove, MoveStats, PositionMoveHash> _table;
+    std::vector<std::string>                                      _runs;
+    uint64_t                                                      _games = 0;
+    GameState                                                     _state;
+};
+
+void BookWorker::add(const uint64_t key, const uint16_t move, const int result) {
+    MoveStats& stats = _table[PositionMove{key, move}];
+    if (result > 0) {
+        ++stats.wins;
+    }
+    else if (result < 0) {
+        ++stats.losses;
+    }
+    else {
+        ++stats.draws;
+    }
+    if (_table.size() >= _options.spill) {
+        spill();
+    }
+}
+
+void BookWorker::spill() {
+    if (_table.empty()) {
+        return;
+    }
+    std::vector<RunRecord> records;
+    records.reserve(_table.size());
+    for (const auto& [position, stats] : _table) {
+        records.push_back(RunRecord{position.key, position.move, stats});
+    }
+    _table.clear();
+    std::sort(records.begin(), records.end(), recordLess);
+
+    const std::string path = (std::filesystem::path(_options.tmpDir) /
+        ("chess-book-" + std::to_string(_id) + "-" + std::to_string(_runs.size()) + ".run")).string();
+    std::ofstream file(path, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(records.data()),
+               static_cast<std::streamsize>(records.size() * sizeof(RunRecord)));
+    if (!file) {
+        std::cerr << "chess-book: can't write " << path << std::endl;
+        std::exit(1);
+    }
+    _runs.push_back(path);
+}
+
+void BookWorker::flush() {
+    spill();
+}
+
+// result is +1 white won, -1 black won, 0 draw
+void BookWorker::replayGame(const std::string& movetext, const int result) {
+    _state.init(START_STATE, WHITE);
+    ++_games;
+
+    size_t pos   = 0;
+    int    plies = 0;
+    int    nest  = 0; // depth inside comments and variations
+    while (pos < movetext.size() && plies < _options.depth) {
+        const char c = movetext[pos];
+        if (c == '{' || c == '(') {
+            ++nest;
+            ++pos;
+            continue;
+        }
+        if (c == '}' || c == ')') {
+            --nest;
+            ++pos;
+            continue;
+        }
+        if (nest > 0 || std::isspace(static_cast<unsigned char>(c))) {
+            ++pos;
+            continue;
+        }
+        if (c == ';') {
+            pos = movetext.find('\n', pos);
+            continue;
+        }
+
+        size_t end = pos;
+        while (end < movetext.size() && !std::isspace(static_cast<unsigned char>(movetext[end])) &&
+            movetext[end] != '{' && movetext[end] != '(' && movetext[end] != ')') {
+            ++end;
+        }
+        std::string token = movetext.substr(pos, end - pos);
+        pos               = end;
+
+        // move numbers ("12." or "12..." or glued "12.e4"), NAGs and the result
+        const size_t dots = token.find_last_of('.');
+        if (dots != std::string::npos) {
+            token = token.substr(dots + 1);
+        }
+        if (token.empty() || token[0] == '$' || token == "1-0" || token == "0-1" || token == "1/2-1/2" || token == "*") {
+            continue;
+        }
+
+        BitMove move;
+        if (!parseSan(_state, token, move)) {
+            return; // a move we can't follow, the rest of the game isn't usable
+        }
+        const int sideResult = _state.color == WHITE ? result : -result;
+        add(polyglotKey(_state), OpeningBook::encodeMove(move), sideResult);
+        _state.pushMove(move);
+        ++plies;
+    }
+}
+
+void BookWorker::processChunk(const Chunk& chunk) {
+    std::ifstream file(chunk.path, std::ios::binary);
+    if (!file) {
+        std::cerr << "chess-book: can't read " << chunk.path << std::endl;
+        return;
+    }
+
+    // A game belongs to the chunk its [Event tag starts in; skip the tail of the previous chunk's game. Reading
+    // from the byte before begin, a line starting exactly at begin is this chunk's, as the previous one stops there.
+    std::string line;
+    uint64_t    offset = chunk.begin;
+    if (chunk.begin > 0) {
+        file.seekg(static_cast<std::streamoff>(chunk.begin - 1));
+        std::getline(file, line);
+        offset = chunk.begin - 1 + line.size() + 1;
+    }
+
+    std::string movetext;
+    int         result  = 2; // none yet
+    bool        inGame  = false;
+    auto        endGame = [&]() {
+        if (inGame && result != 2) {
+            replayGame(movetext, result);
+        }
+        movetext.clear();
+        result = 2;
+        inGame = false;
+    };
+
+    while (std::getline(file, line)) {
+        const uint64_t lineStart = offset;
+        offset += line.size() + 1;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+
+        if (line.rfind("[Event ", 0) == 0) {
+            endGame();
+            if (lineStart >= chunk.end) {
+                break;
+            }
+            inGame = true;
+        }
+        else if (line.rfind("[Result ", 0) == 0) {
+            if (line.find("\"1-0\"") != std::string::npos) {
+                result = 1;
+            }
+            else if (line.find("\"0-1\"") != std::string::npos) {
+                result = -1;
+            }
+            else if (line.find("\"1/2-1/2\"") != std::string::npos) {
+                result = 0;
+            }
+        }
+        else if (inGame && !line.empty() && line[0] != '[') {
+            movetext += line;
+            movetext += '\n';
+        }
+    }
+    endGame();
+}
+
+//
+// merge
+//
+
+class RunReader {
+public:
+    explicit RunReader(const std::string& path)
+        : _file(path, std::ios::binary) {
+        next();
+    }
+    bool             done() const { return _done; }
+    const RunRecord& current() const { return _record; }
+    void             next() {
+        _done = !_file.read(reinterpret_cast<char*>(&_record), sizeof(_record));
+    }
+
+private:
+    std::ifstream _file;
+    RunRecord     _record{};
+    bool          _done = false;
+};
+
+// Writes one position's moves that pass the cutoffs. Weights follow Polyglot's 2 * wins + draws, scaled into
+// 16 bits when the most played move would overflow them.
+static uint64_t writePosition(std::ofstream& out, const uint64_t key, const std::vector<RunRecord>& moves,
+                              const BuilderOptions& options) {
+    std::vector<BookEntry> entries;
+    uint64_t               best = 0;
+    for (const RunRecord& record : moves) {
+        const MoveStats& stats = record.stats;
+        const uint64_t   games = static_cast<uint64_t>(stats.wins) + stats.draws + stats.losses;
+        const uint64_t   score = 2ULL * stats.wins + stats.draws;
+        if (games < static_cast<uint64_t>(options.minGames) || score == 0) {
+            continue;
+        }
+        entries.push_back(BookEntry{key, record.move, 0, static_cast<uint32_t>(std::min<uint64_t>(score, UINT32_MAX))});
+        best = std::max(best, score);
+    }
+
+    // learn holds the raw score until the weights are known
+    for (BookEntry& entry : entries) {
+        const uint64_t score = entry.learn;
+        entry.weight = static_cast<uint16_t>(std::max<uint64_t>(1, best > 0xFFFF ? score * 0xFFFF / best : score));
+        entry.learn  = 0;
+    }
+    std::sort(entries.begin(), entries.end(), [](const BookEntry& a, const BookEntry& b) { return a.weight > b.weight; });
+
+    unsigned char buffer[BOOK_ENTRY_SIZE];
+    for (const BookEntry& entry : entries) {
+        OpeningBook::writeEntry(buffer, entry);
+        out.write(reinterpret_cast<const char*>(buffer), sizeof(buffer));
+    }
+    return entries.size();
+}
+
+// k-way merge of every worker's sorted runs, summing the counts of equal (position, move) records
+static uint64_t mergeRuns(const std::vector<std::string>& runs, const BuilderOptions& options) {
+    std::ofstream out(options.output, std::ios::binary);
+    if (!out) {
+        std::cerr << "chess-book: can't write " << options.output << std::endl;
+        std::exit(1);
+    }
+
+    std::vector<std::unique_ptr<RunReader>> readers;
+    for (const std::string& run : runs) {
+        readers.push_back(std::make_unique<RunReader>(run));
+    }
+    auto later = [&](const size_t a, const size_t b) {
+        return recordLess(readers[b]->current(), readers[a]->current());
+    };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(later)> heap(later);
+    for (size_t i = 0; i < readers.size(); i++) {
+        if (!readers[i]->done()) {
+            heap.push(i);
+        }
+    }
+
+    uint64_t               written = 0;
+    std::vector<RunRecord> position;
+    while (!heap.empty()) {
+        const size_t     index  = heap.top();
+        const RunRecord& record = readers[index]->current();
+        heap.pop();
+
+        if (!position.empty() && position.back().key != record.key) {
+            written += writePosition(out, position.back().key, position, options);
+            position.clear();
+        }
+        if (!position.empty() && position.back().move == record.move) {
+            position.back().stats.wins += record.stats.wins;
+            position.back().stats.draws += record.stats.draws;
+            position.back().stats.losses += record.stats.losses;
+        }
+        else {
+            position.push_back(record);
+        }
+
+        readers[index]->next();
+        if (!readers[index]->done()) {
+            heap.push(index);
+        }
+    }
+    if (!position.empty()) {
+        written += writePosition(out, position.back().key, position, options);
+    }
+    return written;
+}
+
+static void usage() {
+    std::cerr << "usage: chess-book [--depth plies] [--min-games n] [--threads n] [--spill entries] [--tmp dir]"
+        " -o book.bin games.pgn..." << std::endl;
+    std::exit(1);
+}
+
+int main(int argc, char** argv) {
+    BuilderOptions options;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg     = argv[i];
+        const bool        hasNext = i + 1 < argc;
+        if (arg == "--depth" && hasNext) {
+            options.depth = std::clamp(std::atoi(argv[++i]), 1, MAX_DEPTH - 1);
+        }
+        else if (arg == "--min-games" && hasNext) {
+            options.minGames = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--threads" && hasNext) {
+            options.threads = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--spill" && hasNext) {
+            options.spill = std::max<size_t>(1024, std::strtoull(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--tmp" && hasNext) {
+            options.tmpDir = argv[++i];
+        }
+        else if (arg == "-o" && hasNext) {
+            options.output = argv[++i];
+        }
+        else if (!arg.empty() && arg[0] == '-') {
+            usage();
+        }
+        else {
+            options.inputs.push_back(arg);
+        }
+    }
+    if (options.output.empty() || options.inputs.empty()) {
+        usage();
+    }
+
+    // shard every file into chunks so a single large database still keeps all the threads busy
+    std::vector<Chunk> chunks;
+    for (const std::string& input : options.inputs) {
+        std::error_code error;
+        const uint64_t  size = std::filesystem::file_size(input, error);
+        if (error) {
+            std::cerr << "chess-book: can't read " << input << std::endl;
+            return 1;
+        }
+        for (uint64_t begin = 0; begin < std::max<uint64_t>(size, 1); begin += CHUNK_BYTES) {
+            chunks.push_back(Chunk{input, begin, std::min(size, begin + CHUNK_BYTES)});
+        }
+    }
+
+    // the first init builds the shared move generation tables, do it before the threads start
+    GameState warmup;
+    warmup.init(START_STATE, WHITE);
+
+    const auto                               start = std::chrono::steady_clock::now();
+    std::atomic<size_t>                      nextChunk{0};
+    std::vector<std::unique_ptr<BookWorker>> workers;
+    std::vector<std::thread>                 threads;
+    for (int id = 0; id < options.threads; id++) {
+        workers.push_back(std::make_unique<BookWorker>(options, id));
+    }
+    for (int id = 0; id < options.threads; id++) {
+        threads.emplace_back([&, id]() {
+            for (size_t index = nextChunk++; index < chunks.size(); index = nextChunk++) {
+                workers[id]->processChunk(chunks[index]);
+            }
+            workers[id]->flush();
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    uint64_t                 games = 0;
+    std::vector<std::string> runs;
+    for (const auto& worker : workers) {
+        games += worker->games();
+        runs.insert(runs.end(), worker->runs().begin(), worker->runs().end());
+    }
+
+    const uint64_t entries = mergeRuns(runs, options);
+    for (const std::string& run : runs) {
+        std::filesystem::remove(run);
+    }
+
+    const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    std::cout << "chess-book: " << games << " games, " << runs.size() << " runs, " << entries << " book entries in "
+        << elapsed.count() << " ms" << std::endl;
+    return 0;
+}
@@ -0,0 +1,130 @@
+#include "AllocTracker.h"
+
+const char* ALLOC_TAG_NAMES[AllocTagCount] = {"other", "ui", "game", "ai", "search"};
+
+uint64_t AllocCounts::totalCount() const {
+    uint64_t total = 0;
+    for (const uint64_t tagCount : count) {
+        total += tagCount;
+    }
+    return total;
+}
+
+uint64_t AllocCounts::totalBytes() const {
+    uint64_t total = 0;
+    for (const uint64_t tagBytes : bytes) {
+        total += tagBytes;
+    }
+    return total;
+}
+
+#ifdef CHESS_ALLOC_TRACKING
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Everything operator new touches is constant initialised, so it counts correctly however early in static
+// initialisation it is first called, and nothing here allocates.
+static std::atomic<uint64_t> _count[AllocTagCount];
+static std::atomic<uint64_t> _bytes[AllocTagCount];
+static std::atomic<uint64_t> _frees;
+static thread_local AllocTag _tag = AllocOther;
+
+// written and read only by the UI thread
+static AllocCounts _history[ALLOC_HISTORY_FRAMES];
+static int         _historyHead = 0;
+
+AllocTag allocSwapTag(const AllocTag tag) {
+    const AllocTag previous = _tag;
+    _tag = tag;
+    return previous;
+}
+
+void allocFrame() {
+    _historyHead = (_historyHead + 1) % ALLOC_HISTORY_FRAMES;
+    AllocCounts& frame = _history[_historyHead];
+    for (int tag = 0; tag < AllocTagCount; tag++) {
+        frame.count[tag] = _count[tag].exchange(0, std::memory_order_relaxed);
+        frame.bytes[tag] = _bytes[tag].exchange(0, std::memory_order_relaxed);
+    }
+    frame.frees = _frees.exchange(0, std::memory_order_relaxed);
+}
+
+const AllocCounts& allocHistory(const int age) {
+    return _history[(_historyHead - age + ALLOC_HISTORY_FRAMES) % ALLOC_HISTORY_FRAMES];
+}
+
+static void* allocate(const std::size_t size) {
+    _count[_tag].fetch_add(1, std::memory_order_relaxed);
+    _bytes[_tag].fetch_add(size, std::memory_order_relaxed);
+    // malloc(0) may return null, new must return a distinct pointer
+    return std::malloc(size > 0 ? size : 1);
+}
+
+static void release(void* pointer) {
+    if (pointer) {
+        _frees.fetch_add(1, std::memory_order_relaxed);
+        std::free(pointer);
+    }
+}
+
+// the plain, array, nothrow and sized forms; the over-aligned ones keep the library's allocator uncounted
+void* operator new(const std::size_t size) {
+    void* pointer = allocate(size);
+    if (!pointer) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void* operator new[](const std::size_t size) {
+    return operator new(size);
+}
+
+void* operator new(const std::size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size);
+}
+
+void* operator new[](const std::size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size);
+}
+
+void operator delete(void* pointer) noexcept {
+    release(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    release(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept {
+    release(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept {
+    release(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+    release(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept {
+    release(pointer);
+}
+
+#else
+
+AllocTag allocSwapTag(const AllocTag tag) {
+    return tag;
+}
+
+void allocFrame() {
+}
+
+const AllocCounts& allocHistory(int) {
+    static const AllocCounts empty;
+    return empty;
+}
+
+#endif
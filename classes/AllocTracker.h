@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+
+// Counts every allocation made through global operator new, per frame and per subsystem, so the UI's steady state
+// can be driven to none. Only built when the build is configured with CHESS_ALLOC_TRACKING on: it replaces the
+// global operator new and delete for the whole program. Otherwise the tags compile to nothing.
+//
+//   ALLOC_TAG(AllocGame);     // allocations on this thread count as Game until the end of the enclosing block
+//
+// A thread's allocations count under its innermost tag, AllocOther outside any.
+#ifdef CHESS_ALLOC_TRACKING
+#define ALLOC_CONCAT_(a, b) a##b
+#define ALLOC_CONCAT(a, b)  ALLOC_CONCAT_(a, b)
+#define ALLOC_TAG(tag)      AllocTagScope ALLOC_CONCAT(_allocTag, __LINE__)(tag)
+#else
+#define ALLOC_TAG(tag)      do {} while (0)
+#endif
+
+enum AllocTag {
+    AllocOther,  // ImGui, the platform backend, anything untagged
+    AllocUI,     // the application's windows
+    AllocGame,   // the board, its pieces and turns
+    AllocAI,     // choosing the AI's move on the UI thread
+    AllocSearch, // the search threads
+    AllocTagCount
+};
+
+extern const char* ALLOC_TAG_NAMES[AllocTagCount];
+
+constexpr int ALLOC_HISTORY_FRAMES = 240;
+
+// one frame's allocations; frees can't be split by tag or size, a block may be freed under another tag than it
+// was allocated under
+struct AllocCounts {
+    uint64_t count[AllocTagCount] = {};
+    uint64_t bytes[AllocTagCount] = {};
+    uint64_t frees                = 0;
+
+    uint64_t totalCount() const;
+    uint64_t totalBytes() const;
+};
+
+// Ends the current frame, called once per frame from the UI thread. The counts since the previous call become
+// the newest frame of the history.
+void               allocFrame();
+// age 0 is the frame allocFrame() last ended, up to ALLOC_HISTORY_FRAMES - 1; frames before the first are empty
+const AllocCounts& allocHistory(int age);
+
+AllocTag allocSwapTag(AllocTag tag);
+
+class AllocTagScope {
+public:
+    explicit AllocTagScope(const AllocTag tag) : _previous(allocSwapTag(tag)) {}
+    ~AllocTagScope() { allocSwapTag(_previous); }
+    AllocTagScope(const AllocTagScope&)            = delete;
+    AllocTagScope& operator=(const AllocTagScope&) = delete;
+
+private:
+    AllocTag _previous;
+};
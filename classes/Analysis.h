@@ -0,0 +1,90 @@
+#pragma once
+
+#include "Search.h"
+#include <algorithm>
+#include <atomic>
+
+// moves of the principal variation kept per iteration
+constexpr int ANALYSIS_MAX_PV = 16;
+
+// one completed iteration of the search, as the analysis panel shows it
+struct AnalysisRow {
+    int      depth;
+    int      selDepth;
+    int      score; // side to move's point of view
+    uint64_t nodes;
+    int64_t  time;  // milliseconds since the search started
+    int      hashfull;
+    int      pvLength;
+    BitMove  pv[ANALYSIS_MAX_PV];
+};
+
+// every iteration of the current search so far, fixed size so publishing never allocates
+struct AnalysisSnapshot {
+    uint64_t    search   = 0; // counts searches, so a reader can tell a new search from more of the same one
+    int         rowCount = 0;
+    AnalysisRow rows[MAX_DEPTH];
+    // the main thread's counters as of the last row, every thread's once the search is over
+    SearchStats stats;
+};
+
+// Hands snapshots from the search thread to the UI thread through a triple buffer: the writer fills its own
+// buffer and swaps it with the shared middle one, the reader swaps the middle one with its own when it's new.
+// Neither side ever waits for the other, and the search only pays for it once per iteration.
+class AnalysisChannel {
+public:
+    // writer: a new search, its rows start empty
+    void reset() {
+        ++_pending.search;
+        _pending.rowCount = 0;
+        _pending.stats.reset();
+        publish();
+    }
+
+    // writer: one more iteration
+    void add(const AnalysisRow& row, const SearchStats& stats) {
+        if (_pending.rowCount < MAX_DEPTH) {
+            _pending.rows[_pending.rowCount++] = row;
+        }
+        _pending.stats = stats;
+        publish();
+    }
+
+    // writer: the search is over, with its final counters
+    void finish(const SearchStats& stats) {
+        _pending.stats = stats;
+        publish();
+    }
+
+    // reader: swaps in the latest snapshot if one was published since the last call, true if it did
+    bool update() {
+        if (!(_middle.load(std::memory_order_relaxed) & FRESH)) {
+            return false;
+        }
+        _front = _middle.exchange(_front, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+
+    // reader: the snapshot swapped in by the last update()
+    const AnalysisSnapshot& front() const { return _buffers[_front]; }
+
+private:
+    static constexpr int INDEX = 3;
+    static constexpr int FRESH = 4;
+
+    void publish() {
+        // only the rows in use are copied
+        AnalysisSnapshot& back = _buffers[_back];
+        back.search            = _pending.search;
+        back.rowCount          = _pending.rowCount;
+        back.stats             = _pending.stats;
+        std::copy(_pending.rows, _pending.rows + _pending.rowCount, back.rows);
+        _back = _middle.exchange(_back | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    AnalysisSnapshot _buffers[3];
+    AnalysisSnapshot _pending;     // the writer's running copy
+    int              _back  = 0;   // writer's
+    std::atomic<int> _middle{1};   // shared, FRESH when the reader hasn't taken it yet
+    int              _front = 2;   // reader's
+};
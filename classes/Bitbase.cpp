@@ -0,0 +1,181 @@
+#include "Bitbase.h"
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+constexpr int KPK_POSITIONS = 2 * 24 * 64 * 64;
+// a known win gains this much per rank the pawn has advanced, so the search pushes it home
+constexpr int KPK_PAWN_RANK_BONUS = 50;
+
+static uint64_t _kpkWins[KPK_POSITIONS / 64];
+
+enum KpkResult : uint8_t {
+    KpkInvalid = 0,
+    KpkUnknown = 1,
+    KpkDraw    = 2,
+    KpkWin     = 4,
+};
+
+static int kpkIndex(const int whiteToMove, const int whiteKing, const int blackKing, const int pawn) {
+    return whiteKing | (blackKing << 6) | (whiteToMove << 12) | ((pawn & 7) << 13) | (((pawn >> 3) - 1) << 15);
+}
+
+static uint64_t whitePawnAttacks(const int pawn) {
+    const uint64_t bit = 1ULL << pawn;
+    return ((bit & NotAFile) << 7) | ((bit & NotHFile) << 9);
+}
+
+static int distance(const int a, const int b) {
+    return std::max(std::abs((a & 7) - (b & 7)), std::abs((a >> 3) - (b >> 3)));
+}
+
+static KpkResult classify(const int whiteToMove, const int whiteKing, const int blackKing, const int pawn) {
+    const uint64_t whiteKingAttacks = GameState::pieceAttacks(King, whiteKing, 0);
+    const uint64_t blackKingAttacks = GameState::pieceAttacks(King, blackKing, 0);
+    const uint64_t pawnAttacks      = whitePawnAttacks(pawn);
+
+    if (whiteKing == blackKing || whiteKing == pawn || blackKing == pawn || (whiteKingAttacks & (1ULL << blackKing))) {
+        return KpkInvalid;
+    }
+    if (whiteToMove && (pawnAttacks & (1ULL << blackKing))) {
+        return KpkInvalid;
+    }
+
+    const int promotion = pawn + 8;
+    if (whiteToMove && (pawn >> 3) == 6 && whiteKing != promotion && blackKing != promotion &&
+        (distance(blackKing, promotion) > 1 || (whiteKingAttacks & (1ULL << promotion)))) {
+        // the new queen can't be taken, and wins unless it stalemates
+        const uint64_t queenAttacks = GameState::pieceAttacks(Queen, promotion, (1ULL << whiteKing) | (1ULL << blackKing));
+        if ((blackKingAttacks & ~(whiteKingAttacks | queenAttacks)) || (queenAttacks & (1ULL << blackKing))) {
+            return KpkWin;
+        }
+    }
+    if (!whiteToMove) {
+        const uint64_t escapes = blackKingAttacks & ~(whiteKingAttacks | pawnAttacks);
+        if (!escapes) {
+            return (pawnAttacks & (1ULL << blackKing)) ? KpkWin : KpkDraw;
+        }
+        if (blackKingAttacks & (1ULL << pawn) & ~whiteKingAttacks) {
+            return KpkDraw;
+        }
+    }
+    return KpkUnknown;
+}
+
+// one step of the iteration: the best the side to move can do given its children, or KpkUnknown
+static KpkResult resolve(const std::vector<uint8_t>& results, const int whiteToMove, const int whiteKing,
+                         const int blackKing, const int pawn) {
+    const uint64_t whiteKingAttacks = GameState::pieceAttacks(King, whiteKing, 0);
+    const uint64_t blackKingAttacks = GameState::pieceAttacks(King, blackKing, 0);
+    const KpkResult good            = whiteToMove ? KpkWin : KpkDraw;
+    const KpkResult bad             = whiteToMove ? KpkDraw : KpkWin;
+    int             seen            = 0;
+
+    if (whiteToMove) {
+        for (uint64_t moves = whiteKingAttacks & ~blackKingAttacks & ~(1ULL << pawn); moves; moves &= moves - 1) {
+            seen |= results[kpkIndex(0, __builtin_ctzll(moves), blackKing, pawn)];
+        }
+        const int push = pawn + 8;
+        if ((pawn >> 3) < 6 && push != whiteKing && push != blackKing) {
+            seen |= results[kpkIndex(0, whiteKing, blackKing, push)];
+            const int twice = pawn + 16;
+            if ((pawn >> 3) == 1 && twice != whiteKing && twice != blackKing) {
+                seen |= results[kpkIndex(0, whiteKing, blackKing, twice)];
+            }
+        }
+    }
+    else {
+        for (uint64_t moves = blackKingAttacks & ~whiteKingAttacks & ~whitePawnAttacks(pawn) & ~(1ULL << pawn); moves;
+             moves &= moves - 1) {
+            seen |= results[kpkIndex(1, whiteKing, __builtin_ctzll(moves), pawn)];
+        }
+    }
+
+    if (seen & good) return good;
+    if (seen & KpkUnknown) return KpkUnknown;
+    return bad;
+}
+
+void initKpkBitbase() {
+    std::vector<uint8_t> results(KPK_POSITIONS, KpkInvalid);
+    for (int whiteToMove = 0; whiteToMove < 2; whiteToMove++) {
+        for (int pawn = 8; pawn < 56; pawn++) {
+            if ((pawn & 7) > 3) continue;
+            for (int whiteKing = 0; whiteKing < 64; whiteKing++) {
+                for (int blackKing = 0; blackKing < 64; blackKing++) {
+                    results[kpkIndex(whiteToMove, whiteKing, blackKing, pawn)] = classify(whiteToMove, whiteKing, blackKing, pawn);
+                }
+            }
+        }
+    }
+
+    // positions still unknown when nothing changes are draws: white never forces a win from them
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (int index = 0; index < KPK_POSITIONS; index++) {
+            if (results[index] != KpkUnknown) continue;
+            const int whiteKing   = index & 63;
+            const int blackKing   = (index >> 6) & 63;
+            const int whiteToMove = (index >> 12) & 1;
+            const int pawn        = ((index >> 15) + 1) * 8 + ((index >> 13) & 3);
+            const KpkResult result = resolve(results, whiteToMove, whiteKing, blackKing, pawn);
+            if (result != KpkUnknown) {
+                results[index] = result;
+                changed        = true;
+            }
+        }
+    }
+
+    std::memset(_kpkWins, 0, sizeof(_kpkWins));
+    for (int index = 0; index < KPK_POSITIONS; index++) {
+        if (results[index] == KpkWin) {
+            _kpkWins[index >> 6] |= 1ULL << (index & 63);
+        }
+    }
+}
+
+bool kpkIsWin(int whiteKing, int whitePawn, int blackKing, const bool whiteToMove) {
+    // the bitbase only holds the pawn on files a-d
+    if ((whitePawn & 7) > 3) {
+        whiteKing ^= 7;
+        whitePawn ^= 7;
+        blackKing ^= 7;
+    }
+    const int index = kpkIndex(whiteToMove ? 1 : 0, whiteKing, blackKing, whitePawn);
+    return (_kpkWins[index >> 6] >> (index & 63)) & 1;
+}
+
+bool evaluateKpk(const GameState& state, int& score) {
+    if (state.pieceCount != 3) {
+        return false;
+    }
+    int pawn = -1;
+    for (int square = 0; square < 64; square++) {
+        const char piece = state.state[square];
+        if (piece == 'P' || piece == 'p') {
+            pawn = square;
+        }
+        else if (piece != '0' && piece != 'K' && piece != 'k') {
+            return false;
+        }
+    }
+    if (pawn < 0) {
+        return false;
+    }
+
+    // seen from the pawn's side, as white
+    const bool strongIsWhite = state.state[pawn] == 'P';
+    const int  flip          = strongIsWhite ? 0 : 56;
+    const int  strongKing    = state.kingSquare[strongIsWhite ? 0 : 1] ^ flip;
+    const int  weakKing      = state.kingSquare[strongIsWhite ? 1 : 0] ^ flip;
+    pawn ^= flip;
+    // the move generator doesn't promote, so a pawn can be left on the last rank
+    if (pawn < 8 || pawn >= 56) {
+        return false;
+    }
+
+    const bool strongToMove = (state.color == WHITE) == strongIsWhite;
+    const int  strongScore  = kpkIsWin(strongKing, pawn, weakKing, strongToMove) ? SCORE_KNOWN_WIN + KPK_PAWN_RANK_BONUS * (pawn >> 3) : 0;
+    score = strongToMove ? strongScore : -strongScore;
+    return true;
+}
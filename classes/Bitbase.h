@@ -0,0 +1,17 @@
+#pragma once
+
+#include "GameState.h"
+
+// scores for endings known to be won, above any ordinary evaluation and below tablebase and mate scores
+constexpr int SCORE_KNOWN_WIN = 10000;
+
+// Builds the king and pawn versus king win/draw bitbase by retrograde iteration: both sides to move x 24 pawn
+// squares (files a-d, ranks 2-7) x 64 x 64 king squares, a bit each, 24 KB. Called once from GameState::init.
+void initKpkBitbase();
+
+// true if the side with the pawn wins; squares are given with that side as white, the pawn on any file
+bool kpkIsWin(int whiteKing, int whitePawn, int blackKing, bool whiteToMove);
+
+// Exact KPK score from the side to move's point of view: 0 for draws, SCORE_KNOWN_WIN plus the pawn's progress
+// for wins. Returns false for any other material.
+bool evaluateKpk(const GameState& state, int& score);
@@ -1,4 +1,6 @@
 #include "Chess.h"
+#include "Trace.h"
+#include "AllocTracker.h"
 #include <limits>
 #include <cmath>
 #include <random>
@@ -58,9 +60,33 @@ Chess::Chess() {
 
         return bitboard;
     });
+
+    if (_network.load(NNUE_NETWORK_FILE)) {
+        _search.setNetwork(&_network);
+    }
+    _book.open(OPENING_BOOK_FILE);
+    if (_tablebases.load(TABLEBASE_DIRECTORY) > 0) {
+        _search.setTablebases(&_tablebases);
+    }
+    _search.setInfoCallback([this](const SearchInfo& info) {
+        if (!_analysisEnabled.load(std::memory_order_relaxed) || info.multiPv != 1) {
+            return;
+        }
+        AnalysisRow row;
+        row.depth    = info.depth;
+        row.selDepth = info.selDepth;
+        row.score    = info.score;
+        row.nodes    = info.nodes;
+        row.time     = info.time;
+        row.hashfull = info.hashfull;
+        row.pvLength = std::min<int>(static_cast<int>(info.pv.size()), ANALYSIS_MAX_PV);
+        std::copy(info.pv.begin(), info.pv.begin() + row.pvLength, row.pv);
+        _analysis.add(row, *info.stats);
+    });
 }
 
 Chess::~Chess() {
+    stopSearch();
     delete _grid;
 }
 
@@ -102,6 +128,13 @@ void Chess::setUpBoard() {
     setAIPlayer(AI_PLAYER);
 
     startGame();
+
+    GameState state;
+    state.init(stateString().c_str(), sideToMove());
+    _positionHistory = {state.hash};
+    _halfmoveClock   = 0;
+    _doublePushFile  = -1;
+    _pieceTaken      = false;
 }
 
 void Chess::FENtoBoard(const std::string& fen) {
@@ -240,6 +273,7 @@ bool Chess::canBitMoveFromTo(Bit& bit, BitHolder& src, BitHolder& dst) {
 }
 
 void Chess::stopGame() {
+    stopSearch();
     _grid->forEachSquare([](ChessSquare* square, int x, int y) {
         square->destroyBit();
     });
@@ -262,9 +296,49 @@ Player* Chess::checkForWinner() {
 }
 
 bool Chess::checkForDraw() {
+    if (_halfmoveClock >= 100) {
+        return true;
+    }
+    // threefold repetition: the current position, and the same side to move, every other entry back
+    int repeats = 0;
+    for (int i = static_cast<int>(_positionHistory.size()) - 1; i >= 0; i -= 2) {
+        if (_positionHistory[i] == _positionHistory.back() && ++repeats == 3) {
+            return true;
+        }
+    }
     return false;
 }
 
+char Chess::sideToMove() {
+    return getCurrentPlayer()->playerNumber() == 0 ? WHITE : BLACK;
+}
+
+void Chess::pieceTaken(Bit* bit) {
+    _pieceTaken = true;
+}
+
+void Chess::bitMovedFromTo(Bit& bit, BitHolder& src, BitHolder& dst) {
+    // record the position before endTurn asks checkForDraw about it; the mover is still the current player
+    if (_pieceTaken || static_cast<ChessPiece>(bit.gameTag() & 0x7) == Pawn) {
+        _positionHistory.clear();
+        _halfmoveClock = 0;
+    }
+    else {
+        ++_halfmoveClock;
+    }
+    _pieceTaken = false;
+    const int fromSquare = static_cast<ChessSquare&>(src).getSquareIndex();
+    const int toSquare   = static_cast<ChessSquare&>(dst).getSquareIndex();
+    _doublePushFile = static_cast<ChessPiece>(bit.gameTag() & 0x7) == Pawn && std::abs(toSquare - fromSquare) == 16
+                          ? fromSquare % 8 : -1;
+
+    GameState state;
+    state.init(stateString().c_str(), sideToMove() == WHITE ? BLACK : WHITE);
+    _positionHistory.push_back(state.hash);
+
+    Game::bitMovedFromTo(bit, src, dst);
+}
+
 std::string Chess::initialStateString() {
     return stateString();
 }
@@ -426,74 +500,110 @@ void Chess::makeMove(const BitMove& move) {
     bitMovedFromTo(*bit, *from, *to);
 }
 
-static int evaluateBoard(const GameState& state) {
-    int values[128];
-    values['P'] = -100;
-    values['N'] = -200;
-    values['B'] = -230;
-    values['R'] = -400;
-    values['Q'] = -900;
-    values['K'] = -2000;
-    values['p'] = 100;
-    values['n'] = 200;
-    values['b'] = 230;
-    values['r'] = 400;
-    values['q'] = 900;
-    values['k'] = 2000;
-    values['0'] = 0;
-
-    int score = 0;
-    for (int i = 0; i < 64; i++) {
-        score += values[state.state[i]];
-    }
-
-    return score;
+bool Chess::gameHasAI() {
+    return true;
 }
 
-static int negamax(GameState& state, const int depth, int alpha, const int beta) {
-    if (depth == 0) return evaluateBoard(state);
 
-    const auto moves   = state.generateAllMoves();
-    int        bestVal = -1000000;
-    for (const auto& move : moves) {
-        state.pushMove(move);
-        bestVal = std::max(bestVal, -negamax(state, depth - 1, -beta, -alpha));
-        state.popState();
-        alpha = std::max(alpha, bestVal);
-        if (alpha >= beta) {
-            break;
+void Chess::updateAI() {
+    TRACE_SCOPE("updateAI");
+    ALLOC_TAG(AllocAI);
+    if (!gameHasAI()) return;
+    GameState state;
+    state.init(stateString().c_str(), sideToMove());
+    state.doublePushFile = _doublePushFile;
+    // the last entry is the position being searched
+    state.setGameHistory(std::vector<uint64_t>(_positionHistory.begin(), _positionHistory.end() - 1), _halfmoveClock);
+
+    if (_searchThread.joinable() && _pondering) {
+        if (state.hash == _ponderHash) {
+            // the human played the expected reply, the search runs on to its full depth as the real one
+            _pondering = false;
+        }
+        else {
+            stopSearch();
         }
     }
 
-    return bestVal;
-}
+    if (_searchThread.joinable()) {
+        // still thinking, come back next frame
+        if (!_searchDone.load(std::memory_order_acquire)) {
+            return;
+        }
+        _searchThread.join();
+        if (!_searchFound) {
+            return;
+        }
+        if (_analysisEnabled.load(std::memory_order_relaxed)) {
+            _analysis.finish(_search.stats());
+        }
 
-bool Chess::gameHasAI() {
-    return true;
-}
+        std::cout << _search.stats().toJson() << std::endl;
 
+        makeMove(_searchBest);
+        startPondering();
+        return;
+    }
 
-void Chess::updateAI() {
-    if (!gameHasAI()) return;
-    GameState state;
-    state.init(stateString().c_str(), 1 - getCurrentPlayer()->playerNumber());
+    BitMove bestMove;
+    if (_gameOptions.useOpeningBook && _book.pickMove(state, bestMove)) {
+        makeMove(bestMove);
+        return;
+    }
+    startSearch(std::make_unique<GameState>(state), false);
+}
+
+void Chess::startSearch(std::unique_ptr<GameState> position, const bool ponder) {
+    _pondering  = ponder;
+    _ponderHash = position->hash;
+    _searchDone.store(false, std::memory_order_relaxed);
+    _analysis.reset();
+
+    _search.resetStop();
+    _searchThread = std::thread([this, position = std::move(position)]() {
+        TRACE_THREAD_NAME("search");
+        ALLOC_TAG(AllocSearch);
+        _searchFound = _search.think(*position, AI_SEARCH_DEPTH, _searchBest);
+        _searchDone.store(true, std::memory_order_release);
+    });
+}
 
-    auto           moves    = state.generateAllMoves();
-    int            bestVal  = -1000000;
-    const BitMove* bestMove = nullptr;
+void Chess::startPondering() {
+    // only while a human thinks, another AI would answer at once
+    const std::vector<BitMove>& pv = _search.pv();
+    if (_gameOptions.AIvsAI || getCurrentPlayer()->isAIPlayer() || pv.size() < 2) {
+        return;
+    }
 
-    for (const auto& move : moves) {
-        state.pushMove(move);
-        const int moveVal = -negamax(state, 5, -1000000, 1000000);
-        state.popState();
+    GameState reply;
+    reply.init(stateString().c_str(), sideToMove());
+    reply.setGameHistory({}, _halfmoveClock);
+    reply.pushMove(pv[1]);
+    char board[64];
+    std::memcpy(board, reply.state, sizeof(board));
+
+    // a fresh state so the search gets the whole stack, with the history the game will have after the reply
+    auto position = std::make_unique<GameState>();
+    position->init(board, reply.color);
+    position->setGameHistory(reply.halfmoveClock == 0 ? std::vector<uint64_t>() : _positionHistory, reply.halfmoveClock);
+    startSearch(std::move(position), true);
+}
 
-        if (moveVal > bestVal) {
-            bestVal  = moveVal;
-            bestMove = &move;
-        }
+void Chess::stopSearch() {
+    if (_searchThread.joinable()) {
+        _search.stop();
+        _searchThread.join();
+        _search.resetStop();
     }
+    _pondering = false;
+}
 
-    if (bestMove) {
-        makeMove(*bestMove);
+std::string Chess::searchStatus() const {
+    if (!_searchThread.joinable()) {
+        return "idle";
+    }
+    if (_pondering) {
+        return "pondering";
     }
+    return _searchDone.load(std::memory_order_relaxed) ? "done" : "thinking";
 }
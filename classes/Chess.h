@@ -4,9 +4,24 @@
 #include "Grid.h"
 #include "Bitboard.h"
 #include "GameState.h"
+#include "Search.h"
+#include "OpeningBook.h"
+#include "Tablebase.h"
+#include "Analysis.h"
 #include <array>
+#include <atomic>
+#include <memory>
+#include <thread>
 
 constexpr int pieceSize = 80;
+// plies searched by the AI, including the root move
+constexpr int AI_SEARCH_DEPTH = 6;
+// optional network; without it the AI uses the classical evaluation
+constexpr const char* NNUE_NETWORK_FILE = "resources/chess.nnue";
+// optional book consulted before searching while GameOptions::useOpeningBook is set
+constexpr const char* OPENING_BOOK_FILE = "resources/book.bin";
+// optional endgame tables, one .ctb file per material signature
+constexpr const char* TABLEBASE_DIRECTORY = "resources/tablebases";
 
 namespace BitBoardIndex {
     enum Index_ : uint8_t {
@@ -75,20 +90,54 @@ public:
     Grid* getGrid() override { return _grid; }
 
     void makeMove(const BitMove& move);
+    void bitMovedFromTo(Bit& bit, BitHolder& src, BitHolder& dst) override;
+    void pieceTaken(Bit* bit) override;
 
     void updateAI() override;
     bool gameHasAI() override;
 
+    // the AI's search as it runs, for the analysis panel; nothing is published while it's disabled
+    AnalysisChannel& analysis() { return _analysis; }
+    void             setAnalysisEnabled(bool enabled) { _analysisEnabled.store(enabled, std::memory_order_relaxed); }
+    // what the AI is searching right now, for the panel's title line
+    std::string      searchStatus() const;
+
 private:
     Bit*    PieceForPlayer(const int playerNumber, ChessPiece piece);
     Player* ownerAt(int x, int y) const;
     void    FENtoBoard(const std::string& fen);
     char    pieceNotation(int x, int y) const;
     void    setPieceAt(const int playerNumber, ChessPiece piece, int x, int y);
+    char    sideToMove();
+
+    // The AI searches on a thread of its own so the window keeps drawing while it thinks. After its move it
+    // searches the position after the reply it expects while the human thinks. If the human plays that reply
+    // the search already under way becomes the AI's search, otherwise it's stopped; the table keeps what it
+    // found either way.
+    void startSearch(std::unique_ptr<GameState> position, bool ponder);
+    void startPondering();
+    void stopSearch();
 
     Grid*                    _grid;
     std::array<BitBoard, 64> _knightBitboards;
     std::array<BitBoard, 64> _kingBitboards;
+    NnueNetwork              _network;
+    Search                   _search;
+    OpeningBook              _book;
+    Tablebases               _tablebases;
+    // hashes of the positions since the last capture or pawn move, the current one last
+    std::vector<uint64_t>    _positionHistory;
+    int                      _halfmoveClock  = 0;
+    int                      _doublePushFile = -1; // file of the pawn the last move pushed two squares, -1 if none
+    bool                     _pieceTaken     = false;
+    std::thread              _searchThread;
+    std::atomic<bool>        _searchDone{false};
+    BitMove                  _searchBest;
+    bool                     _searchFound = false;
+    bool                     _pondering   = false; // the search is on the human's time
+    uint64_t                 _ponderHash  = 0;     // position the ponder search is on
+    AnalysisChannel          _analysis;
+    std::atomic<bool>        _analysisEnabled{false};
 
     void        generateKnightMoves(std::vector<BitMove>& moves, BitBoard knightBoard, uint64_t emptySquares) const;
     void        generateKingMoves(std::vector<BitMove>& moves, BitBoard kingBoard, uint64_t emptySquares) const;
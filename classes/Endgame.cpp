@@ -0,0 +1,172 @@
+#include "Endgame.h"
+#include "Bitbase.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+
+// power of two comfortably above twice the number of rules, so probes rarely go past the first slot
+constexpr int ENDGAME_SLOTS = 64;
+// opposite colored bishops and pawns alone leave the stronger side this much of its endgame advantage, in 64ths
+constexpr int OPPOSITE_BISHOPS_SCALE = 22;
+
+static EndgameRule _rules[ENDGAME_SLOTS];
+
+static int slotOf(const uint64_t key) {
+    return static_cast<int>((key * 0x9E3779B97F4A7C15ULL) >> 58);
+}
+
+static int countOf(const uint64_t key, const char piece) {
+    return static_cast<int>((key / MaterialUnit[(unsigned char)piece]) & 15);
+}
+
+static int distance(const int a, const int b) {
+    return std::max(std::abs((a & 7) - (b & 7)), std::abs((a >> 3) - (b >> 3)));
+}
+
+// bonuses that steer the strong side through the mating technique
+static int pushToEdge(const int square) {
+    const int file = square & 7;
+    const int rank = square >> 3;
+    return 20 * (3 - std::min(std::min(file, 7 - file), std::min(rank, 7 - rank)));
+}
+
+static int pushClose(const int a, const int b) {
+    return 10 * (7 - distance(a, b));
+}
+
+static int pushToCorner(const int square, const bool darkCorners) {
+    const int corner = darkCorners ? std::min(distance(square, 0), distance(square, 63)) : std::min(distance(square, 7), distance(square, 56));
+    return 40 * (7 - corner);
+}
+
+static int strongKing(const GameState& state, const char strongSide) {
+    return state.kingSquare[strongSide == WHITE ? 0 : 1];
+}
+
+static int weakKing(const GameState& state, const char strongSide) {
+    return state.kingSquare[strongSide == WHITE ? 1 : 0];
+}
+
+static int materialFor(const GameState& state, const char strongSide) {
+    return strongSide == WHITE ? state.egScore : -state.egScore;
+}
+
+// a lone king against a queen or a rook, with or without more: drive it to the edge with the king close by
+static int evaluateKxk(const GameState& state, const char strongSide) {
+    return SCORE_KNOWN_WIN + materialFor(state, strongSide) + pushToEdge(weakKing(state, strongSide)) +
+        pushClose(strongKing(state, strongSide), weakKing(state, strongSide));
+}
+
+// bishop and knight only mate in a corner of the bishop's color
+static int evaluateKbnk(const GameState& state, const char strongSide) {
+    const char bishop = strongSide == WHITE ? 'B' : 'b';
+    int        square = 0;
+    while (square < 63 && state.state[square] != bishop) {
+        square++;
+    }
+    const bool dark = (((square & 7) + (square >> 3)) & 1) == 0;
+    return SCORE_KNOWN_WIN + pushToEdge(weakKing(state, strongSide)) + pushToCorner(weakKing(state, strongSide), dark) +
+        pushClose(strongKing(state, strongSide), weakKing(state, strongSide));
+}
+
+// queen against rook is won, but slowly: the queen's margin plus the same mating pattern as a lone king
+static int evaluateKqkr(const GameState& state, const char strongSide) {
+    return materialFor(state, strongSide) + pushToEdge(weakKing(state, strongSide)) +
+        pushClose(strongKing(state, strongSide), weakKing(state, strongSide));
+}
+
+static int evaluateKpkRule(const GameState& state, const char strongSide) {
+    int score;
+    if (!evaluateKpk(state, score)) {
+        return materialFor(state, strongSide);
+    }
+    return state.color == strongSide ? score : -score;
+}
+
+// not enough material to mate
+static int evaluateDraw(const GameState&, const char) {
+    return 0;
+}
+
+uint64_t materialKeyOf(const std::string& signature) {
+    uint64_t key   = 0;
+    bool     white = true;
+    for (const char piece : signature) {
+        if (piece == 'v') {
+            white = false;
+            continue;
+        }
+        key += MaterialUnit[(unsigned char)(white ? piece : std::tolower(piece))];
+    }
+    return key;
+}
+
+static void insertRule(const uint64_t key, const EndgameEvaluator evaluate, const char strongSide) {
+    int slot = slotOf(key);
+    while (_rules[slot].key != 0) {
+        slot = (slot + 1) & (ENDGAME_SLOTS - 1);
+    }
+    _rules[slot] = EndgameRule{key, evaluate, strongSide};
+}
+
+// the signature names the strong side first; the rule is added for it playing either color
+static void addRule(const std::string& signature, const EndgameEvaluator evaluate) {
+    const size_t split = signature.find('v');
+    insertRule(materialKeyOf(signature), evaluate, WHITE);
+    insertRule(materialKeyOf(signature.substr(split + 1) + "v" + signature.substr(0, split)), evaluate, BLACK);
+}
+
+void initEndgames() {
+    std::fill(_rules, _rules + ENDGAME_SLOTS, EndgameRule{0, nullptr, WHITE});
+
+    for (const char* signature : {"KQvK", "KRvK", "KQQvK", "KQRvK", "KRRvK", "KQBvK", "KQNvK", "KRBvK", "KRNvK", "KBBvK"}) {
+        addRule(signature, evaluateKxk);
+    }
+    addRule("KBNvK", evaluateKbnk);
+    addRule("KQvKR", evaluateKqkr);
+    addRule("KPvK", evaluateKpkRule);
+    for (const char* signature : {"KNvK", "KBvK", "KNNvK"}) {
+        addRule(signature, evaluateDraw);
+    }
+    insertRule(materialKeyOf("KvK"), evaluateDraw, WHITE);
+}
+
+const EndgameRule* findEndgame(const uint64_t materialKey) {
+    for (int slot = slotOf(materialKey); _rules[slot].key != 0; slot = (slot + 1) & (ENDGAME_SLOTS - 1)) {
+        if (_rules[slot].key == materialKey) {
+            return &_rules[slot];
+        }
+    }
+    return nullptr;
+}
+
+bool evaluateEndgame(const GameState& state, int& score) {
+    const EndgameRule* rule = findEndgame(state.materialKey);
+    if (!rule) {
+        return false;
+    }
+    const int strongScore = rule->evaluate(state, rule->strongSide);
+    score = state.color == rule->strongSide ? strongScore : -strongScore;
+    return true;
+}
+
+int endgameScale(const GameState& state) {
+    const uint64_t key = state.materialKey;
+    if (countOf(key, 'B') != 1 || countOf(key, 'b') != 1) {
+        return 64;
+    }
+    for (const char piece : {'N', 'R', 'Q', 'n', 'r', 'q'}) {
+        if (countOf(key, piece) != 0) {
+            return 64;
+        }
+    }
+
+    int colors = 0;
+    for (int square = 0; square < 64; square++) {
+        if (state.state[square] == 'B' || state.state[square] == 'b') {
+            colors += ((square & 7) + (square >> 3)) & 1;
+        }
+    }
+    // one bishop on each color
+    return colors == 1 ? OPPOSITE_BISHOPS_SCALE : 64;
+}
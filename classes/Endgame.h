@@ -0,0 +1,29 @@
+#pragma once
+
+#include "GameState.h"
+#include <string>
+
+// Evaluation of a material configuration with a known technique, from the strong side's point of view.
+using EndgameEvaluator = int (*)(const GameState& state, char strongSide);
+
+struct EndgameRule {
+    uint64_t         key; // GameState::materialKey, 0 for an empty slot
+    EndgameEvaluator evaluate;
+    char             strongSide;
+};
+
+// GameState::materialKey of a signature such as "KBNvK", white first
+uint64_t materialKeyOf(const std::string& signature);
+
+// registers the known endgames for both colors, called once from initEvaluation
+void initEndgames();
+
+// the rule for the material, nullptr for none; a single probe of a small open-addressed table
+const EndgameRule* findEndgame(uint64_t materialKey);
+
+// Exact or technique score for a registered endgame, from the side to move's point of view.
+// Returns false if the material has no rule.
+bool evaluateEndgame(const GameState& state, int& score);
+
+// Endgame scale in 64ths for material that drifts toward a draw, 64 for none: opposite colored bishops.
+int endgameScale(const GameState& state);
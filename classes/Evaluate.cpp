@@ -0,0 +1,408 @@
+#include "Evaluate.h"
+#include "Endgame.h"
+#include <algorithm>
+#include <cstdlib>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+int16_t PieceSquareMg[128][64];
+int16_t PieceSquareEg[128][64];
+int8_t  PiecePhase[128];
+
+// Piece values and piece-square tables from Ronald Friederich's PeSTO.
+// Tables are laid out as printed, a8 first, so white pieces look up square ^ 56.
+static constexpr int pieceValueMg[7] = {0, 82, 337, 365, 477, 1025, 0};
+static constexpr int pieceValueEg[7] = {0, 94, 281, 297, 512, 936, 0};
+static constexpr int piecePhaseWeight[7] = {0, 0, 1, 1, 2, 4, 0};
+
+static constexpr int pawnMg[64] = {
+      0,   0,   0,   0,   0,   0,   0,   0,
+     98, 134,  61,  95,  68, 126,  34, -11,
+     -6,   7,  26,  31,  65,  56,  25, -20,
+    -14,  13,   6,  21,  23,  12,  17, -23,
+    -27,  -2,  -5,  12,  17,   6,  10, -25,
+    -26,  -4,  -4, -10,   3,   3,  33, -12,
+    -35,  -1, -20, -23, -15,  24,  38, -22,
+      0,   0,   0,   0,   0,   0,   0,   0,
+};
+
+static constexpr int pawnEg[64] = {
+      0,   0,   0,   0,   0,   0,   0,   0,
+    178, 173, 158, 134, 147, 132, 165, 187,
+     94, 100,  85,  67,  56,  53,  82,  84,
+     32,  24,  13,   5,  -2,   4,  17,  17,
+     13,   9,  -3,  -7,  -7,  -8,   3,  -1,
+      4,   7,  -6,   1,   0,  -5,  -1,  -8,
+     13,   8,   8,  10,  13,   0,   2,  -7,
+      0,   0,   0,   0,   0,   0,   0,   0,
+};
+
+static constexpr int knightMg[64] = {
+    -167, -89, -34, -49,  61, -97, -15, -107,
+     -73, -41,  72,  36,  23,  62,   7,  -17,
+     -47,  60,  37,  65,  84, 129,  73,   44,
+      -9,  17,  19,  53,  37,  69,  18,   22,
+     -13,   4,  16,  13,  28,  19,  21,   -8,
+     -23,  -9,  12,  10,  19,  17,  25,  -16,
+     -29, -53, -12,  -3,  -1,  18, -14,  -19,
+    -105, -21, -58, -33, -17, -28, -19,  -23,
+};
+
+static constexpr int knightEg[64] = {
+    -58, -38, -13, -28, -31, -27, -63, -99,
+    -25,  -8, -25,  -2,  -9, -25, -24, -52,
+    -24, -20,  10,   9,  -1,  -9, -19, -41,
+    -17,   3,  22,  22,  22,  11,   8, -18,
+    -18,  -6,  16,  25,  16,  17,   4, -18,
+    -23,  -3,  -1,  15,  10,  -3, -20, -22,
+    -42, -20, -10,  -5,  -2, -20, -23, -44,
+    -29, -51, -23, -15, -22, -18, -50, -64,
+};
+
+static constexpr int bishopMg[64] = {
+    -29,   4, -82, -37, -25, -42,   7,  -8,
+    -26,  16, -18, -13,  30,  59,  18, -47,
+    -16,  37,  43,  40,  35,  50,  37,  -2,
+     -4,   5,  19,  50,  37,  37,   7,  -2,
+     -6,  13,  13,  26,  34,  12,  10,   4,
+      0,  15,  15,  15,  14,  27,  18,  10,
+      4,  15,  16,   0,   7,  21,  33,   1,
+    -33,  -3, -14, -21, -13, -12, -39, -21,
+};
+
+static constexpr int bishopEg[64] = {
+    -14, -21, -11,  -8,  -7,  -9, -17, -24,
+     -8,  -4,   7, -12,  -3, -13,  -4, -14,
+      2,  -8,   0,  -1,  -2,   6,   0,   4,
+     -3,   9,  12,   9,  14,  10,   3,   2,
+     -6,   3,  13,  19,   7,  10,  -3,  -9,
+    -12,  -3,   8,  10,  13,   3,  -7, -15,
+    -14, -18,  -7,  -1,   4,  -9, -15, -27,
+    -23,  -9, -23,  -5,  -9, -16,  -5, -17,
+};
+
+static constexpr int rookMg[64] = {
+     32,  42,  32,  51,  63,   9,  31,  43,
+     27,  32,  58,  62,  80,  67,  26,  44,
+     -5,  19,  26,  36,  17,  45,  61,  16,
+    -24, -11,   7,  26,  24,  35,  -8, -20,
+    -36, -26, -12,  -1,   9,  -7,   6, -23,
+    -45, -25, -16, -17,   3,   0,  -5, -33,
+    -44, -16, -20,  -9,  -1,  11,  -6, -71,
+    -19, -13,   1,  17,  16,   7, -37, -26,
+};
+
+static constexpr int rookEg[64] = {
+     13,  10,  18,  15,  12,  12,   8,   5,
+     11,  13,  13,  11,  -3,   3,   8,   3,
+      7,   7,   7,   5,   4,  -3,  -5,  -3,
+      4,   3,  13,   1,   2,   1,  -1,   2,
+      3,   5,   8,   4,  -5,  -6,  -8, -11,
+     -4,   0,  -5,  -1,  -7, -12,  -8, -16,
+     -6,  -6,   0,   2,  -9,  -9, -11,  -3,
+     -9,   2,   3,  -1,  -5, -13,   4, -20,
+};
+
+static constexpr int queenMg[64] = {
+    -28,   0,  29,  12,  59,  44,  43,  45,
+    -24, -39,  -5,   1, -16,  57,  28,  54,
+    -13, -17,   7,   8,  29,  56,  47,  57,
+    -27, -27, -16, -16,  -1,  17,  -2,   1,
+     -9, -26,  -9, -10,  -2,  -4,   3,  -3,
+    -14,   2, -11,  -2,  -5,   2,  14,   5,
+    -35,  -8,  11,   2,   8,  15,  -3,   1,
+     -1, -18,  -9,  10, -15, -25, -31, -50,
+};
+
+static constexpr int queenEg[64] = {
+     -9,  22,  22,  27,  27,  19,  10,  20,
+    -17,  20,  32,  41,  58,  25,  30,   0,
+    -20,   6,   9,  49,  47,  35,  19,   9,
+      3,  22,  24,  45,  57,  40,  57,  36,
+    -18,  28,  19,  47,  31,  34,  39,  23,
+    -16, -27,  15,   6,   9,  17,  10,   5,
+    -22, -23, -30, -16, -16, -23, -36, -32,
+    -33, -28, -22, -43,  -5, -32, -20, -41,
+};
+
+static constexpr int kingMg[64] = {
+    -65,  23,  16, -15, -56, -34,   2,  13,
+     29,  -1, -20,  -7,  -8,  -4, -38, -29,
+     -9,  24,   2, -16, -20,   6,  22, -22,
+    -17, -20, -12, -27, -30, -25, -14, -36,
+    -49,  -1, -27, -39, -46, -44, -33, -51,
+    -14, -14, -22, -46, -44, -30, -15, -27,
+      1,   7,  -8, -64, -43, -16,   9,   8,
+    -15,  36,  12, -54,   8, -28,  24,  14,
+};
+
+static constexpr int kingEg[64] = {
+    -74, -35, -18, -18, -11,  15,   4, -17,
+    -12,  17,  14,  17,  17,  38,  23,  11,
+     10,  17,  23,  15,  20,  45,  44,  13,
+     -8,  22,  24,  27,  26,  33,  26,   3,
+    -18,  -4,  21,  24,  27,  23,   9, -11,
+    -19,  -3,  11,  21,  23,  16,   7,  -9,
+    -27, -11,   4,  13,  14,   4,  -5, -17,
+    -53, -34, -21, -11, -28, -14, -24, -43,
+};
+
+// pawn structure, indexed by the pawn's rank counted from its own side
+static constexpr int passedPawnMg[8] = {0, 5, 10, 15, 30, 50, 80, 0};
+static constexpr int passedPawnEg[8] = {0, 10, 20, 35, 60, 100, 150, 0};
+static constexpr int isolatedPawnMg  = -10;
+static constexpr int isolatedPawnEg  = -15;
+static constexpr int doubledPawnMg   = -10;
+static constexpr int doubledPawnEg   = -25;
+static constexpr int backwardPawnMg  = -8;
+static constexpr int backwardPawnEg  = -10;
+// per king step from a passed pawn's stop square, times the pawn's rank from the fourth up: the enemy king's
+// distance counts for the pawn, ours against it, so an escorted runner the enemy king can't catch scores most
+static constexpr int passedEnemyKingEg = 4;
+static constexpr int passedOwnKingEg   = 2;
+// per square a piece type attacks that holds no piece of ours and no enemy pawn covers, counted set-wise
+static constexpr int mobilityMg[King + 1] = {0, 0, 4, 3, 2, 1, 0};
+static constexpr int mobilityEg[King + 1] = {0, 0, 4, 3, 4, 2, 0};
+// own pawns one and two ranks in front of the king, on its file and the neighbouring ones
+static constexpr int pawnShieldNear = 12;
+static constexpr int pawnShieldFar  = 6;
+
+static constexpr uint64_t FileA = 0x0101010101010101ULL;
+
+static uint64_t passedMask[2][64];   // enemy pawns here stop a pawn on this square from being passed
+static uint64_t supportMask[2][64];  // own pawns here (beside or behind) can defend a pawn on this square
+static uint64_t adjacentFiles[8];
+static uint64_t shieldNearMask[2][64];
+static uint64_t shieldFarMask[2][64];
+
+static inline int popCount(const uint64_t b) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    return static_cast<int>(__popcnt64(b));
+#else
+    return __builtin_popcountll(b);
+#endif
+}
+
+static constexpr const int* tablesMg[7] = {nullptr, pawnMg, knightMg, bishopMg, rookMg, queenMg, kingMg};
+static constexpr const int* tablesEg[7] = {nullptr, pawnEg, knightEg, bishopEg, rookEg, queenEg, kingEg};
+
+void initEvaluation() {
+    initEndgames();
+    std::memset(PieceSquareMg, 0, sizeof(PieceSquareMg));
+    std::memset(PieceSquareEg, 0, sizeof(PieceSquareEg));
+    std::memset(PiecePhase, 0, sizeof(PiecePhase));
+
+    const char* whitePieces = "PNBRQK";
+    const char* blackPieces = "pnbrqk";
+    for (int piece = Pawn; piece <= King; piece++) {
+        const unsigned char white = whitePieces[piece - 1];
+        const unsigned char black = blackPieces[piece - 1];
+        PiecePhase[white] = piecePhaseWeight[piece];
+        PiecePhase[black] = piecePhaseWeight[piece];
+
+        for (int square = 0; square < 64; square++) {
+            PieceSquareMg[white][square] = pieceValueMg[piece] + tablesMg[piece][square ^ 56];
+            PieceSquareEg[white][square] = pieceValueEg[piece] + tablesEg[piece][square ^ 56];
+            PieceSquareMg[black][square] = -(pieceValueMg[piece] + tablesMg[piece][square]);
+            PieceSquareEg[black][square] = -(pieceValueEg[piece] + tablesEg[piece][square]);
+        }
+    }
+
+    for (int file = 0; file < 8; file++) {
+        adjacentFiles[file] = (file > 0 ? FileA << (file - 1) : 0) | (file < 7 ? FileA << (file + 1) : 0);
+    }
+
+    for (int square = 0; square < 64; square++) {
+        const int      rank  = square / 8;
+        const int      file  = square % 8;
+        const uint64_t files = adjacentFiles[file] | (FileA << file);
+
+        passedMask[0][square]  = 0;
+        passedMask[1][square]  = 0;
+        supportMask[0][square] = 0;
+        supportMask[1][square] = 0;
+        for (int r = 0; r < 8; r++) {
+            const uint64_t rankMask = 0xFFULL << (r * 8);
+            if (r > rank) passedMask[0][square] |= files & rankMask;
+            if (r < rank) passedMask[1][square] |= files & rankMask;
+            if (r <= rank) supportMask[0][square] |= adjacentFiles[file] & rankMask;
+            if (r >= rank) supportMask[1][square] |= adjacentFiles[file] & rankMask;
+        }
+
+        shieldNearMask[0][square] = rank < 7 ? (files & (0xFFULL << ((rank + 1) * 8))) : 0;
+        shieldFarMask[0][square]  = rank < 6 ? (files & (0xFFULL << ((rank + 2) * 8))) : 0;
+        shieldNearMask[1][square] = rank > 0 ? (files & (0xFFULL << ((rank - 1) * 8))) : 0;
+        shieldFarMask[1][square]  = rank > 1 ? (files & (0xFFULL << ((rank - 2) * 8))) : 0;
+    }
+}
+
+static void evaluatePawns(PawnEntry& entry, const GameState& state) {
+    entry.pawns[0] = 0;
+    entry.pawns[1] = 0;
+    for (int square = 0; square < 64; square++) {
+        if (state.state[square] == 'P') entry.pawns[0] |= 1ULL << square;
+        else if (state.state[square] == 'p') entry.pawns[1] |= 1ULL << square;
+    }
+
+    // squares attacked by each side's pawns
+    const uint64_t attacks[2] = {
+        ((entry.pawns[0] & ~(FileA << 7)) << 9) | ((entry.pawns[0] & ~FileA) << 7),
+        ((entry.pawns[1] & ~(FileA << 7)) >> 7) | ((entry.pawns[1] & ~FileA) >> 9),
+    };
+
+    int mg[2] = {0, 0};
+    int eg[2] = {0, 0};
+    for (int side = 0; side < 2; side++) {
+        const uint64_t own   = entry.pawns[side];
+        const uint64_t enemy = entry.pawns[side ^ 1];
+        entry.passed[side]   = 0;
+
+        for (int file = 0; file < 8; file++) {
+            const int count = popCount(own & (FileA << file));
+            if (count > 1) {
+                mg[side] += doubledPawnMg * (count - 1);
+                eg[side] += doubledPawnEg * (count - 1);
+            }
+        }
+
+        BitBoard(own).forEachBit([&](int square) {
+            const int file         = square % 8;
+            const int relativeRank = side == 0 ? square / 8 : 7 - square / 8;
+            const int stopSquare   = side == 0 ? square + 8 : square - 8;
+
+            if ((passedMask[side][square] & enemy) == 0) {
+                entry.passed[side] |= 1ULL << square;
+                mg[side] += passedPawnMg[relativeRank];
+                eg[side] += passedPawnEg[relativeRank];
+            }
+
+            if ((own & adjacentFiles[file]) == 0) {
+                mg[side] += isolatedPawnMg;
+                eg[side] += isolatedPawnEg;
+            }
+            else if (relativeRank < 7 && (supportMask[side][square] & own) == 0 &&
+                     (attacks[side ^ 1] & (1ULL << stopSquare))) {
+                mg[side] += backwardPawnMg;
+                eg[side] += backwardPawnEg;
+            }
+        });
+    }
+
+    entry.key     = state.pawnKey;
+    entry.mgScore = mg[0] - mg[1];
+    entry.egScore = eg[0] - eg[1];
+}
+
+PawnTable::PawnTable(const size_t entries) {
+    size_t count = 1;
+    while (count * 2 <= entries) {
+        count *= 2;
+    }
+    _entries.assign(count, PawnEntry{});
+    _mask = count - 1;
+    // key 0 is a valid pawn key (no pawns), make sure the empty entries can't match it
+    _entries[0].key = 1;
+}
+
+static int distance(const int a, const int b) {
+    return std::max(std::abs(a / 8 - b / 8), std::abs(a % 8 - b % 8));
+}
+
+// the kings move far more often than the pawns, so this is scored from the cached passers on every evaluation
+static int passedPawnKings(const PawnEntry& pawns, const GameState& state) {
+    int score[2] = {0, 0};
+    for (int side = 0; side < 2; side++) {
+        BitBoard(pawns.passed[side]).forEachBit([&](int square) {
+            const int relativeRank = side == 0 ? square / 8 : 7 - square / 8;
+            if (relativeRank < 3) return;
+            const int stopSquare = side == 0 ? square + 8 : square - 8;
+            score[side] += (passedEnemyKingEg * distance(state.kingSquare[side ^ 1], stopSquare) -
+                            passedOwnKingEg * distance(state.kingSquare[side], stopSquare)) * (relativeRank - 2);
+        });
+    }
+    return score[0] - score[1];
+}
+
+static void addMobility(const GameState& state, int& mg, int& eg) {
+    for (int side = 0; side < 2; side++) {
+        const char     color = side == 0 ? WHITE : BLACK;
+        const uint64_t own   = state._bitboards[side == 0 ? WHITE_ALL_PIECES : BLACK_ALL_PIECES].getData();
+        const uint64_t safe  = ~own & ~state.attackedBy(-color, Pawn);
+        const int      sign  = side == 0 ? 1 : -1;
+        for (int type = Knight; type <= Queen; type++) {
+            const int squares = popCount(state.attackedBy(color, static_cast<ChessPiece>(type)) & safe);
+            mg += sign * mobilityMg[type] * squares;
+            eg += sign * mobilityEg[type] * squares;
+        }
+    }
+}
+
+const PawnEntry& PawnTable::probe(const GameState& state) {
+    ++_probes;
+    PawnEntry& entry = _entries[state.pawnKey & _mask];
+    if (entry.key == state.pawnKey) {
+        ++_hits;
+        return entry;
+    }
+    evaluatePawns(entry, state);
+    return entry;
+}
+
+EvalCache::EvalCache(const size_t entries) {
+    size_t count = 1;
+    while (count * 2 <= entries) {
+        count *= 2;
+    }
+    _entries.resize(count);
+    _mask = count - 1;
+    clear();
+}
+
+void EvalCache::clear() {
+    // no reachable position hashes to 0, so it marks an empty slot
+    std::fill(_entries.begin(), _entries.end(), EvalEntry{0, 0});
+}
+
+bool EvalCache::probe(const uint64_t key, int& score) {
+    ++_probes;
+    const EvalEntry& entry = _entries[key & _mask];
+    if (entry.key != key) {
+        return false;
+    }
+    ++_hits;
+    score = entry.score;
+    return true;
+}
+
+void EvalCache::store(const uint64_t key, const int score) {
+    _entries[key & _mask] = EvalEntry{key, score};
+}
+
+int evaluateBoard(GameState& state, PawnTable& pawnTable) {
+    int known;
+    if (evaluateEndgame(state, known)) {
+        return known;
+    }
+
+    const PawnEntry& pawns = pawnTable.probe(state);
+
+    // the king's pawn shield only matters while there is material left to attack it
+    const int shield = pawnShieldNear * popCount(shieldNearMask[0][(int)state.kingSquare[0]] & pawns.pawns[0]) +
+        pawnShieldFar * popCount(shieldFarMask[0][(int)state.kingSquare[0]] & pawns.pawns[0]) -
+        pawnShieldNear * popCount(shieldNearMask[1][(int)state.kingSquare[1]] & pawns.pawns[1]) -
+        pawnShieldFar * popCount(shieldFarMask[1][(int)state.kingSquare[1]] & pawns.pawns[1]);
+
+    int mobilityMgScore = 0;
+    int mobilityEgScore = 0;
+    state.updateAttackMaps();
+    addMobility(state, mobilityMgScore, mobilityEgScore);
+
+    const int mg    = state.mgScore + pawns.mgScore + shield + mobilityMgScore;
+    const int eg    = (state.egScore + pawns.egScore + passedPawnKings(pawns, state) + mobilityEgScore) *
+                      endgameScale(state) / 64;
+    const int phase = state.phase < MAX_PHASE ? state.phase : MAX_PHASE;
+    const int score = (mg * phase + eg * (MAX_PHASE - phase)) / MAX_PHASE;
+    return state.color == WHITE ? score : -score;
+}
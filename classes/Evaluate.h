@@ -0,0 +1,68 @@
+#pragma once
+
+#include "GameState.h"
+#include <vector>
+
+constexpr int MAX_PHASE = 24;
+
+// Pawn structure terms depend only on where the pawns are, so they are cached by GameState::pawnKey.
+struct PawnEntry {
+    uint64_t key;
+    uint64_t pawns[2];  // white, black
+    uint64_t passed[2]; // passed pawns of each side, scored against the kings outside the cache
+    int      mgScore;   // pawn structure score, white positive
+    int      egScore;
+};
+
+// Direct-mapped pawn structure cache, one per search thread so it needs no locking.
+class PawnTable {
+public:
+    explicit PawnTable(size_t entries = 4096);
+
+    // returns the entry for the state's pawns, computing it on a miss
+    const PawnEntry& probe(const GameState& state);
+
+    uint64_t probes() const { return _probes; }
+    uint64_t hits() const { return _hits; }
+    void     resetCounters() { _probes = _hits = 0; }
+
+private:
+    std::vector<PawnEntry> _entries;
+    uint64_t               _mask;
+    uint64_t               _probes = 0;
+    uint64_t               _hits   = 0;
+};
+
+// Direct-mapped cache of static evaluations keyed by the full Zobrist hash, so leaves reached again through
+// qsearch or sibling subtrees are not evaluated twice. One per search thread.
+struct EvalEntry {
+    uint64_t key;
+    int      score;
+};
+
+class EvalCache {
+public:
+    explicit EvalCache(size_t entries = 65536);
+
+    bool probe(uint64_t key, int& score);
+    void store(uint64_t key, int score);
+    // scores depend on the evaluator, so switching evaluators must clear the cache
+    void clear();
+
+    uint64_t probes() const { return _probes; }
+    uint64_t hits() const { return _hits; }
+    void     resetCounters() { _probes = _hits = 0; }
+
+private:
+    std::vector<EvalEntry> _entries;
+    uint64_t               _mask;
+    uint64_t               _probes = 0;
+    uint64_t               _hits   = 0;
+};
+
+// fills PieceSquareMg, PieceSquareEg and PiecePhase, called once from GameState::init
+void initEvaluation();
+
+// Incremental material and piece-square sums, cached pawn structure and mobility, blended by game phase,
+// from the point of view of the side to move. Mobility reads the node's attack maps, built here if need be.
+int evaluateBoard(GameState& state, PawnTable& pawnTable);
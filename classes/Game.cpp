@@ -2,6 +2,8 @@
 #include "Bit.h"
 #include "BitHolder.h"
 #include "Turn.h"
+#include "Trace.h"
+#include "AllocTracker.h"
 #include "../Application.h"
 
 Game::Game()
@@ -16,6 +18,7 @@ Game::Game()
 	_gameOptions.score = 0;
 	_gameOptions.AIDepthSearches = 0;
 	_gameOptions.AIvsAI = false;
+	_gameOptions.useOpeningBook = true;
 
 	_table = nullptr;
 	_winner = nullptr;
@@ -89,6 +92,8 @@ void Game::startGame()
 
 void Game::endTurn()
 {
+	TRACE_SCOPE("endTurn");
+	ALLOC_TAG(AllocGame);
 	_gameOptions.currentTurnNo++;
 	std::string startState = stateString();
 	Turn *turn = new Turn;
@@ -108,6 +113,7 @@ void Game::endTurn()
 //
 void Game::scanForMouse()
 {
+	TRACE_SCOPE("scanForMouse");
 	if (gameHasAI() && getCurrentPlayer()->isAIPlayer())
 	{
 		return;
@@ -177,6 +183,8 @@ void Game::findDropTarget(ImVec2 &pos)
 //
 void Game::drawFrame()
 {
+	TRACE_SCOPE("drawFrame");
+	ALLOC_TAG(AllocGame);
 	scanForMouse();
 
 	Grid* grid = getGrid();
@@ -42,6 +42,7 @@ struct GameOptions
 	int AIDepthSearches;
 	int AIMAXDepth;
 	bool AIvsAI;
+	bool useOpeningBook;
 };
 
 class Game
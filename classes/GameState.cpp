@@ -1,20 +1,55 @@
 
 #include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdlib>
 #include <iostream>
 #include "GameState.h"
 #include "MagicBitboards.h"
+#include "Evaluate.h"
+#include "Bitbase.h"
 
 static int _bitboardLookup[128];
 static bool _initedMagic = false;
 static BitBoard _pawnAttacks[2][64]; // Precomputed pawn attacks for each square
+// each init() takes its own range of push serials, so accumulators cached for one GameState never match another
+static std::atomic<uint64_t> _serialBase{0};
+
+uint64_t ZobristPieces[128][64];
+uint64_t ZobristBlackToMove;
+uint64_t MaterialUnit[128];
+
+// filled before main rather than by the first init(), so material keys of signatures can be computed before any
+// GameState exists, as Tablebases::load does
+static const bool _materialUnitFilled = [] {
+    const char* materialOrder = "PNBRQKpnbrqk";
+    for (int slot = 0; slot < 12; slot++) {
+        MaterialUnit[(unsigned char)materialOrder[slot]] = 1ULL << (4 * slot);
+    }
+    return true;
+}();
+
+// fixed seed so hashes (and anything keyed on them) are the same from run to run
+static uint64_t zobristRandom() {
+    static uint64_t seed = 0x9E3779B97F4A7C15ULL;
+    uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
 
 void GameState::init(const char* newState, char player) {
     std::memcpy(state, newState, 64);
     color = player;
     flags = 0;
-    _zobristHash[0] = 0;
-    _zobristHash[1] = 0;
     _attackBitBoard.setData(0);
+    std::memset(_attackedBy, 0, sizeof(_attackedBy));
+    _attacksValid = false;
+    stackPtr = 0;
+    halfmoveClock = 0;
+    pliesFromNull = 0;
+    doublePushFile = -1;
+    gameHistory.clear();
     // Clear all bitboards
     for (int i = 0; i < e_numBitboards; ++i) {
         _bitboards[i].setData(0);
@@ -44,12 +79,190 @@ void GameState::init(const char* newState, char player) {
             _pawnAttacks[1][square].setData(generatePawnAttacksBitBoard(square, BLACK));
         }
 
+        for (const char piece : {'P', 'N', 'B', 'R', 'Q', 'K', 'p', 'n', 'b', 'r', 'q', 'k'}) {
+            for (int square = 0; square < 64; square++) {
+                ZobristPieces[(unsigned char)piece][square] = zobristRandom();
+            }
+        }
+        ZobristBlackToMove = zobristRandom();
+        initEvaluation();
+        initKpkBitbase();
+
         _initedMagic = true;
 
-        std::cout << "initialized magic bitboards and bitboard lookup" << std::endl;
+        std::cerr << "initialized magic bitboards and bitboard lookup" << std::endl;
+    }
+
+    hash = computeHash();
+    pawnKey = computePawnKey();
+    pushSerial = _serialBase.fetch_add(1ULL << 40, std::memory_order_relaxed);
+    dirtyStack[stackPtr].serial = ++pushSerial;
+    dirtyStack[stackPtr].count = 0;
+    computeEvaluation(mgScore, egScore, phase);
+    pieceCount = 0;
+    materialKey = 0;
+    for (int square = 0; square < 64; square++) {
+        materialKey += MaterialUnit[(unsigned char)state[square]];
+        if (state[square] != '0')
+            ++pieceCount;
+        if (state[square] == 'K')
+            kingSquare[0] = square;
+        else if (state[square] == 'k')
+            kingSquare[1] = square;
     }
 }
 
+void GameState::setGameHistory(const std::vector<uint64_t>& hashes, int halfmoves) {
+    gameHistory = hashes;
+    halfmoveClock = halfmoves;
+    pliesFromNull = halfmoves;
+}
+
+bool GameState::isRepetition() const {
+    // only positions with the same side to move can match, and none from before the last irreversible move;
+    // the position two plies back differs by the last two moves, so the earliest candidate is four back
+    const int limit = std::min(halfmoveClock, pliesFromNull);
+    const int historySize = (int)gameHistory.size();
+    for (int back = 4; back <= limit; back += 2) {
+        const int level = stackPtr - back;
+        if (level >= 0) {
+            if (stateStack[level].hash == hash)
+                return true;
+        } else {
+            if (historySize + level < 0)
+                break;
+            if (gameHistory[historySize + level] == hash)
+                return true;
+        }
+    }
+    return false;
+}
+
+bool GameState::initFen(const std::string& fen) {
+    char board[64];
+    std::memset(board, '0', sizeof(board));
+    size_t pos = 0;
+    int rank = 7;
+    int file = 0;
+    for (; pos < fen.size() && fen[pos] != ' '; pos++) {
+        const char c = fen[pos];
+        if (c == '/') {
+            if (file != 8 || rank == 0)
+                return false;
+            --rank;
+            file = 0;
+        } else if (c >= '1' && c <= '8') {
+            file += c - '0';
+        } else if (std::strchr("PNBRQKpnbrqk", c) && file < 8) {
+            board[rank * 8 + file++] = c;
+        } else {
+            return false;
+        }
+        if (file > 8)
+            return false;
+    }
+    if (rank != 0 || file != 8 || std::count(board, board + 64, 'K') != 1 || std::count(board, board + 64, 'k') != 1)
+        return false;
+
+    // active color, castling, en passant, halfmove clock
+    std::string fields[4];
+    for (std::string& field : fields) {
+        while (pos < fen.size() && fen[pos] == ' ')
+            ++pos;
+        while (pos < fen.size() && fen[pos] != ' ')
+            field += fen[pos++];
+    }
+    init(board, fields[0] == "b" ? BLACK : WHITE);
+    if (fields[2].size() == 2 && fields[2][0] >= 'a' && fields[2][0] <= 'h')
+        doublePushFile = fields[2][0] - 'a';
+    if (!fields[3].empty() && std::isdigit((unsigned char)fields[3][0]))
+        setGameHistory({}, std::atoi(fields[3].c_str()));
+    return true;
+}
+
+std::string GameState::moveToUci(const BitMove& move) {
+    std::string text;
+    text += (char)('a' + move.from % 8);
+    text += (char)('1' + move.from / 8);
+    text += (char)('a' + move.to % 8);
+    text += (char)('1' + move.to / 8);
+    if (move.piece == Pawn && (move.to < 8 || move.to >= 56))
+        text += 'q';
+    return text;
+}
+
+bool GameState::moveFromUci(const std::string& text, BitMove& move) {
+    if (text.size() < 4 || text[0] < 'a' || text[0] > 'h' || text[1] < '1' || text[1] > '8' ||
+        text[2] < 'a' || text[2] > 'h' || text[3] < '1' || text[3] > '8')
+        return false;
+    const int from = (text[1] - '1') * 8 + (text[0] - 'a');
+    const int to = (text[3] - '1') * 8 + (text[2] - 'a');
+    const char piece = state[from];
+    const bool own = piece != '0' && (piece < 'a') == (color == WHITE);
+    if (!own)
+        return false;
+
+    // castling and en passant aren't generated, they are taken on trust when the pieces are where they must be
+    const int homeRank = color == WHITE ? 0 : 56;
+    const char rook = color == WHITE ? 'R' : 'r';
+    if ((piece == 'K' || piece == 'k') && from == homeRank + 4) {
+        if (to == homeRank + 6 && state[homeRank + 7] == rook && state[homeRank + 5] == '0' && state[homeRank + 6] == '0') {
+            move = BitMove(from, to, King, KingSideCastle);
+            return true;
+        }
+        if (to == homeRank + 2 && state[homeRank] == rook && state[homeRank + 1] == '0' && state[homeRank + 2] == '0' &&
+            state[homeRank + 3] == '0') {
+            move = BitMove(from, to, King, QueenSideCastle);
+            return true;
+        }
+    }
+    const int forward = color == WHITE ? 8 : -8;
+    if ((piece == 'P' || piece == 'p') && state[to] == '0' && std::abs(to % 8 - from % 8) == 1 && to - from - forward == to % 8 - from % 8 &&
+        state[to - forward] == (color == WHITE ? 'p' : 'P')) {
+        move = BitMove(from, to, Pawn, EnPassant);
+        return true;
+    }
+
+    for (const BitMove& candidate : generateAllMoves()) {
+        if (candidate.from == from && candidate.to == to) {
+            move = candidate;
+            if (candidate.piece == Pawn && (to < 8 || to >= 56))
+                move.flags |= IsPromotion;
+            return true;
+        }
+    }
+    return false;
+}
+
+uint64_t GameState::computePawnKey() const {
+    uint64_t result = 0;
+    for (int square = 0; square < 64; square++) {
+        if (state[square] == 'P' || state[square] == 'p')
+            result ^= ZobristPieces[(unsigned char)state[square]][square];
+    }
+    return result;
+}
+
+void GameState::computeEvaluation(int& mg, int& eg, int& gamePhase) const {
+    mg = 0;
+    eg = 0;
+    gamePhase = 0;
+    for (int square = 0; square < 64; square++) {
+        const unsigned char piece = state[square];
+        mg += PieceSquareMg[piece][square];
+        eg += PieceSquareEg[piece][square];
+        gamePhase += PiecePhase[piece];
+    }
+}
+
+uint64_t GameState::computeHash() const {
+    uint64_t result = color == WHITE ? 0 : ZobristBlackToMove;
+    for (int square = 0; square < 64; square++) {
+        result ^= ZobristPieces[(unsigned char)state[square]][square];
+    }
+    return result;
+}
+
 void GameState::shutdown() {
     cleanupMagicBitboards();
 }
@@ -216,18 +429,71 @@ uint64_t GameState::generatePawnAttacksBitBoard(int square, char color) {
     return bitboard;
 }
 
-const BitBoard GameState::generatePawnAttacks(const BitBoard pawns, char color) {
-    BitBoard result(0);
+void GameState::computeAttackMaps() {
+    for (int side = 0; side < 2; side++) {
+        const int base = side == 0 ? WHITE_PAWNS : BLACK_PAWNS;
+        const char sideColor = side == 0 ? WHITE : BLACK;
+        BitBoard occupancy = _bitboards[OCCUPANCY];
+        if (sideColor != color) {
+            occupancy = occupancy & ~_bitboards[color == WHITE ? WHITE_KING : BLACK_KING];
+        }
 
-    pawns.forEachBit([&](int fromSquare) {
-        // Using precomputed or dynamic logic
-        result |= _pawnAttacks[color == WHITE ? 0 : 1][fromSquare];
-    });
+        const uint64_t pawns = _bitboards[base + WHITE_PAWNS].getData();
+        uint64_t* attacks = _attackedBy[side];
+        attacks[Pawn] = side == 0 ? WHITE_PAWN_ATTACKS(pawns) : BLACK_PAWN_ATTACKS(pawns);
+        attacks[Knight] = generatePieceAttackList<Knight>(_bitboards[base + WHITE_KNIGHTS], occupancy).getData();
+        attacks[Bishop] = generatePieceAttackList<Bishop>(_bitboards[base + WHITE_BISHOPS], occupancy).getData();
+        attacks[Rook] = generatePieceAttackList<Rook>(_bitboards[base + WHITE_ROOKS], occupancy).getData();
+        attacks[Queen] = generatePieceAttackList<Queen>(_bitboards[base + WHITE_QUEENS], occupancy).getData();
+        attacks[King] = generatePieceAttackList<King>(_bitboards[base + WHITE_KING], occupancy).getData();
+        attacks[NoPiece] = attacks[Pawn] | attacks[Knight] | attacks[Bishop] | attacks[Rook] | attacks[Queen] | attacks[King];
+    }
+    _attackBitBoard.setData(attackedBy(color == WHITE ? BLACK : WHITE));
+}
 
-    return result;
+uint64_t GameState::pinnedPieces(char side) const {
+    const int base = side == WHITE ? WHITE_PAWNS : BLACK_PAWNS;
+    const int enemyBase = side == WHITE ? BLACK_PAWNS : WHITE_PAWNS;
+    const BitBoard king = _bitboards[base + WHITE_KING];
+    if (king.getData() == 0)
+        return 0;
+
+    const int kingSquare = king.firstBit();
+    const uint64_t occupancy = _bitboards[OCCUPANCY].getData();
+    const uint64_t enemies = _bitboards[enemyBase + WHITE_ALL_PIECES].getData();
+    const uint64_t enemyQueens = _bitboards[enemyBase + WHITE_QUEENS].getData();
+    const uint64_t rookSnipers = getRookAttacks(kingSquare, enemies) & (_bitboards[enemyBase + WHITE_ROOKS].getData() | enemyQueens);
+    const uint64_t bishopSnipers = getBishopAttacks(kingSquare, enemies) & (_bitboards[enemyBase + WHITE_BISHOPS].getData() | enemyQueens);
+
+    // a lone piece of ours between the king and a slider that sees it through our pieces is pinned
+    uint64_t pinned = 0;
+    BitBoard(rookSnipers).forEachBit([&](int sniper) {
+        const uint64_t between = getRookAttacks(kingSquare, 1ULL << sniper) & getRookAttacks(sniper, 1ULL << kingSquare);
+        const uint64_t blockers = between & occupancy;
+        if (blockers && !(blockers & (blockers - 1)))
+            pinned |= blockers;
+    });
+    BitBoard(bishopSnipers).forEachBit([&](int sniper) {
+        const uint64_t between = getBishopAttacks(kingSquare, 1ULL << sniper) & getBishopAttacks(sniper, 1ULL << kingSquare);
+        const uint64_t blockers = between & occupancy;
+        if (blockers && !(blockers & (blockers - 1)))
+            pinned |= blockers;
+    });
+    return pinned & ~enemies;
 }
 
 // Returns true if 'square' is attacked by any piece belonging to 'attackerColor'
+uint64_t GameState::pieceAttacks(ChessPiece type, int square, uint64_t occupancy) {
+    switch (type) {
+    case Knight: return KnightAttacks[square];
+    case Bishop: return getBishopAttacks(square, occupancy);
+    case Rook:   return getRookAttacks(square, occupancy);
+    case Queen:  return getQueenAttacks(square, occupancy);
+    case King:   return KingAttacks[square];
+    default:     return 0;
+    }
+}
+
 bool GameState::isSquareAttacked(int square, char attackerColor, const BitBoard (&boards)[e_numBitboards]) {
 	const int pawnIdx   = (attackerColor == WHITE) ? WHITE_PAWNS : BLACK_PAWNS;
 	const int knightIdx = (attackerColor == WHITE) ? WHITE_KNIGHTS : BLACK_KNIGHTS;
@@ -241,7 +507,7 @@ bool GameState::isSquareAttacked(int square, char attackerColor, const BitBoard
 
 	// Check Pawn Attacks
 	char targetColor = (attackerColor == WHITE) ? BLACK : WHITE; 
-	if ((generatePawnAttacksBitBoard(square, targetColor) & boards[pawnIdx].getData()) != 0) return true;
+	if ((_pawnAttacks[targetColor == WHITE ? 0 : 1][square].getData() & boards[pawnIdx].getData()) != 0) return true;
 
 	// Check Knight Attacks
 	if ((KnightAttacks[square] & boards[knightIdx].getData()) != 0) return true;
@@ -266,9 +532,20 @@ void GameState::filterOutIllegalMoves(std::vector<BitMove>& moves) {
 	const char myColor = color;
 	const char opponentColor = (color == WHITE) ? BLACK : WHITE;
 	const int myKingIdx = (myColor == WHITE) ? WHITE_KING : BLACK_KING;
+	if (_bitboards[myKingIdx].getData() == 0) return;
+
+	// the attack maps answer the common cases: the king may go anywhere the enemy doesn't attack, and when
+	// not in check any unpinned piece may move; only evasions, pinned pieces and en passant need a board test
+	const uint64_t enemyAttacks = _attackBitBoard.getData();
+	const bool checked = (enemyAttacks & _bitboards[myKingIdx].getData()) != 0;
+	const uint64_t pinned = pinnedPieces(myColor);
 
 	// Remove moves that leave the king in check
 	moves.erase(std::remove_if(moves.begin(), moves.end(), [&](const BitMove& move) {
+		if (move.piece == King)
+			return (enemyAttacks & (1ULL << move.to)) != 0;
+		if (!checked && !(pinned & (1ULL << move.from)) && !(move.flags & EnPassant))
+			return false;
 		
 		// Create a temporary copy of the board state
 		BitBoard tempBoards[e_numBitboards];
@@ -339,11 +616,8 @@ void GameState::filterOutIllegalMoves(std::vector<BitMove>& moves) {
 	}), moves.end());
 }
 
-std::vector<BitMove> GameState::generateAllMoves()
+void GameState::updateBitboards()
 {
-    std::vector<BitMove> moves;
-    moves.reserve(32);
-
     for (int i=0; i<e_numBitboards; i++) {
         _bitboards[i] = 0;
     }
@@ -362,6 +636,54 @@ std::vector<BitMove> GameState::generateAllMoves()
     _bitboards[BLACK_QUEENS].getData() | _bitboards[BLACK_KING].getData();
     
     _bitboards[OCCUPANCY] = _bitboards[WHITE_ALL_PIECES].getData() | _bitboards[BLACK_ALL_PIECES].getData();
+}
+
+bool GameState::inCheck()
+{
+    updateAttackMaps();
+    return (_bitboards[color == WHITE ? WHITE_KING : BLACK_KING].getData() & _attackBitBoard.getData()) != 0;
+}
+
+// Anything besides king and pawns; null-move pruning is unsafe without it because of zugzwang
+bool GameState::hasNonPawnMaterial(char side) const
+{
+    // the knight, bishop, rook and queen counts of materialKey, "NBRQ" for white and "nbrq" for black
+    const uint64_t pieces = side == WHITE ? 0xFFFFULL << 4 : 0xFFFFULL << 28;
+    return (materialKey & pieces) != 0;
+}
+
+// pawn units for captureLosesMaterial; a king never takes a defended piece, so its value only has to be the largest
+static int exchangeValue(const char piece)
+{
+    switch (piece) {
+    case 'P': case 'p': return 1;
+    case 'N': case 'n': case 'B': case 'b': return 3;
+    case 'R': case 'r': return 5;
+    case 'Q': case 'q': return 9;
+    default: return 100;
+    }
+}
+
+bool GameState::captureLosesMaterial(const BitMove& move) const
+{
+    const int victim = (move.flags & EnPassant) ? 1 : exchangeValue(state[move.to]);
+    if (victim >= exchangeValue(state[move.from]))
+        return false;
+    return (_attackBitBoard.getData() & (1ULL << move.to)) != 0;
+}
+
+std::vector<BitMove> GameState::generateAllMoves()
+{
+    std::vector<BitMove> moves;
+    moves.reserve(32);
+    generatePseudoLegalMoves(moves);
+    filterOutIllegalMoves(moves);
+    return moves;
+}
+
+void GameState::generatePseudoLegalMoves(std::vector<BitMove>& moves)
+{
+    updateAttackMaps();
 
     int bitIndex = color == WHITE ? WHITE_PAWNS : BLACK_PAWNS;
     int oppBitIndex = color == WHITE ? BLACK_PAWNS : WHITE_PAWNS;
@@ -372,9 +694,5 @@ std::vector<BitMove> GameState::generateAllMoves()
     generateBishopMoves(moves, _bitboards[WHITE_BISHOPS + bitIndex], _bitboards[OCCUPANCY].getData(), _bitboards[WHITE_ALL_PIECES + bitIndex].getData());
     generateRooksMoves(moves, _bitboards[WHITE_ROOKS + bitIndex], _bitboards[OCCUPANCY].getData(), _bitboards[WHITE_ALL_PIECES + bitIndex].getData());
     generateQueensMoves(moves, _bitboards[WHITE_QUEENS + bitIndex], _bitboards[OCCUPANCY].getData(), _bitboards[WHITE_ALL_PIECES + bitIndex].getData());
-
-    filterOutIllegalMoves(moves);
-
-    return moves;
 }
 
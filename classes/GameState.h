@@ -4,13 +4,14 @@
 #include <iostream>
 #include <cstring>
 #include <cstdint>
+#include <string>
 #include <vector>
 #include "Bitboard.h"
 
 constexpr int WHITE = +1;
 constexpr int BLACK = -1;
 // Define a constant for the maximum depth of your AI.
-constexpr int MAX_DEPTH = 24;
+constexpr int MAX_DEPTH = 64;
 // Define constants for ranks and files
 constexpr uint64_t NotAFile(0xFEFEFEFEFEFEFEFEULL); // A file mask
 constexpr uint64_t NotHFile(0x7F7F7F7F7F7F7F7FULL); // H file mask
@@ -67,27 +68,81 @@ struct BitMove {
 };
 #pragma pack(pop)
 
+// Zobrist keys indexed by the piece character used in state[] and the square, the '0' row stays zero
+extern uint64_t ZobristPieces[128][64];
+extern uint64_t ZobristBlackToMove;
+// Count of one piece kind in GameStateData::materialKey, four bits per kind in "PNBRQKpnbrqk" order, zero for '0'
+extern uint64_t MaterialUnit[128];
+
+// Material plus piece-square values (white positive) and game phase weights, indexed like ZobristPieces.
+// Filled by initEvaluation() in Evaluate.cpp.
+extern int16_t PieceSquareMg[128][64];
+extern int16_t PieceSquareEg[128][64];
+extern int8_t PiecePhase[128];
+
 struct alignas(32) GameStateData {
     char state[64];                 // persisitent
     int flags;
     char color;                     // BLACK or WHITE
+    uint64_t hash;                  // Zobrist hash of state and color, updated incrementally by pushMove
+    int mgScore;                    // middlegame material + piece-square sum, white positive
+    int egScore;                    // endgame material + piece-square sum, white positive
+    int phase;                      // 24 with all minor and major pieces on the board, 0 with none
+    uint64_t pawnKey;               // Zobrist hash of the pawns only, keys the pawn structure cache
+    char kingSquare[2];             // white, black
+    signed char doublePushFile;     // file of the pawn the last move pushed two squares, -1 if it didn't
+    int halfmoveClock;              // plies since the last capture or pawn move, for the fifty-move rule
+    int pliesFromNull;              // plies since the last null move, repetitions can't span one
+    int pieceCount;                 // both sides, kings included
+    uint64_t materialKey;           // sum of MaterialUnit over the pieces: the exact material configuration
 
     GameStateData() : flags(0)
-        , color(WHITE) {
+        , color(WHITE)
+        , hash(0)
+        , mgScore(0)
+        , egScore(0)
+        , phase(0)
+        , pawnKey(0)
+        , kingSquare{0, 0}
+        , doublePushFile(-1)
+        , halfmoveClock(0)
+        , pliesFromNull(0)
+        , pieceCount(0)
+        , materialKey(0) {
         std::memset(state, '0', sizeof(state));
     }
     GameStateData(const GameStateData&) = default;
     GameStateData& operator=(const GameStateData&) = default;
 };
 
+// Pieces removed and placed by the move that reached a stack level, so an NNUE accumulator for that level
+// can be derived from its parent's instead of being rebuilt.
+struct DirtyPieces {
+    uint64_t serial;                // new value on every push, so caches of a reused stack level can tell it changed
+    int count;
+    unsigned char piece[6];         // a move touches at most 6: castling, or a capture with promotion
+    signed char square[6];
+    bool added[6];
+};
+
 class GameState : public GameStateData {
 public:
     GameStateData stateStack[MAX_DEPTH];
     int stackPtr = 0;
 
-    uint64_t _zobristHash[2]; // when one hash value is made, the other is made as well because it's just a xor of the first by the color bit
+    DirtyPieces dirtyStack[MAX_DEPTH + 1];
+    uint64_t pushSerial = 0;
+
+    // hashes of the game positions before the one passed to init, oldest first
+    std::vector<uint64_t> gameHistory;
+
     BitBoard _bitboards[e_numBitboards];
+    // squares the side not to move attacks, filled by computeAttackMaps
     BitBoard _attackBitBoard;
+    // [white, black][piece type] squares attacked by that side's pieces of the type, NoPiece is all of them
+    uint64_t _attackedBy[2][King + 1];
+    // _bitboards and the attack maps describe the current node; every push, pop and init clears it
+    bool _attacksValid = false;
 
     GameState() : stackPtr(0) { }
 
@@ -96,42 +151,157 @@ public:
     inline void pushMove(const BitMove& move) {
         pushState();
         unsigned char fromPiece = state[move.from];
-        state[move.from] = '0';
-        state[move.to] = fromPiece;
+        const bool irreversible = fromPiece == 'P' || fromPiece == 'p' || state[move.to] != '0' || (move.flags & EnPassant);
+        halfmoveClock = irreversible ? 0 : halfmoveClock + 1;
+        doublePushFile = (fromPiece == 'P' || fromPiece == 'p') && (move.to - move.from == 16 || move.from - move.to == 16)
+                             ? move.from % 8 : -1;
+        ++pliesFromNull;
+        removePiece(move.from);
+        removePiece(move.to);
+        placePiece(fromPiece, move.to);
         if (move.flags & KingSideCastle) {
-            state[move.to - 1] = state[move.to + 1];
-            state[move.to + 1] = '0';
+            unsigned char rook = state[move.to + 1];
+            removePiece(move.to + 1);
+            placePiece(rook, move.to - 1);
         } else if (move.flags & QueenSideCastle) {
-            state[move.to + 1] = state[move.to - 2];
-            state[move.to - 2] = '0';
+            unsigned char rook = state[move.to - 2];
+            removePiece(move.to - 2);
+            placePiece(rook, move.to + 1);
         } else if (move.flags & EnPassant) {
             // check for color to determine which direction to capture
             if (fromPiece == 'P') {
-                state[move.to - 8] = '0';
+                removePiece(move.to - 8);
             } else {
-                state[move.to + 8] = '0';
+                removePiece(move.to + 8);
             }
         } else if (move.flags & IsPromotion) {
-            state[move.to] = color == WHITE ? 'Q' : 'q';
+            removePiece(move.to);
+            placePiece(color == WHITE ? 'Q' : 'q', move.to);
         }
         // flip the color bit as it now becomes the other player's turn
         color = (color == WHITE) ? BLACK : WHITE;
+        hash ^= ZobristBlackToMove;
         flags = 0; // invalidate all the flags
     }
 
+    // pass the turn without moving, used by null-move pruning
+    inline void pushNullMove() {
+        pushState();
+        ++halfmoveClock;
+        pliesFromNull = 0;
+        doublePushFile = -1;
+        color = (color == WHITE) ? BLACK : WHITE;
+        hash ^= ZobristBlackToMove;
+        flags = 0;
+    }
+
     inline void pushState() {
         assert(stackPtr < MAX_DEPTH);
+        _attacksValid = false;
         stateStack[stackPtr++] = static_cast<const GameStateData&>(*this);
+        dirtyStack[stackPtr].serial = ++pushSerial;
+        dirtyStack[stackPtr].count = 0;
     }
     inline void popState() {
         assert(stackPtr > 0);
+        _attacksValid = false;
         static_cast<GameStateData&>(*this) = stateStack[--stackPtr];
     }
 
     std::vector<BitMove> generateAllMoves();
+    // generateAllMoves in its two steps, so they can be measured apart: the moves ignoring checks, which leaves
+    // the bitboards and attack maps set up, then dropping those that leave the side to move's king in check
+    void generatePseudoLegalMoves(std::vector<BitMove>& moves);
+    void filterOutIllegalMoves(std::vector<BitMove>& moves);
+    uint64_t computeHash() const;
+    uint64_t computePawnKey() const;
+    void computeEvaluation(int& mg, int& eg, int& gamePhase) const;
+    bool inCheck();
+    bool hasNonPawnMaterial(char side) const;
+
+    // the game so far, so repetitions of positions played before the search started are seen
+    void setGameHistory(const std::vector<uint64_t>& hashes, int halfmoves);
+    // true if the position already occurred on the search path or in the game history
+    bool isRepetition() const;
+    bool isFiftyMoveDraw() const { return halfmoveClock >= 100; }
+
+    // Piece placement, side to move, en passant file and halfmove clock of a FEN string. The castling field is
+    // skipped since the move generator has no castling. Returns false, leaving the state alone, for a malformed board.
+    bool initFen(const std::string& fen);
+    // long algebraic notation as UCI writes it, "e2e4"; a pawn reaching the last rank becomes a queen, "e7e8q"
+    static std::string moveToUci(const BitMove& move);
+    // the move if it can be played here, with the castling, en passant or promotion flag pushMove needs for
+    // the moves the generator doesn't produce; any promotion piece is taken as a queen
+    bool moveFromUci(const std::string& text, BitMove& move);
+
+    // Set-wise attack maps for both sides from the current _bitboards. The side to move's king is left out of
+    // the occupancy when computing the other side's attacks, so squares behind the king on a checking line
+    // count as attacked.
+    void computeAttackMaps();
+    // The bitboards and attack maps of this node, built by the first of inCheck, move generation, evaluation
+    // or captureLosesMaterial to need them after a move and shared by the rest.
+    void updateAttackMaps() {
+        if (!_attacksValid) {
+            updateBitboards();
+            computeAttackMaps();
+            _attacksValid = true;
+        }
+    }
+    // after editing state[] directly, or to time a full rebuild
+    void invalidateAttackMaps() { _attacksValid = false; }
+    // Static exchange test from the attack maps, which must be up to date: the capture gives up material if the
+    // piece taken is worth less than the one taking it and the opponent defends the square. X-rays are ignored.
+    bool captureLosesMaterial(const BitMove& move) const;
+    uint64_t attackedBy(char side, ChessPiece type = NoPiece) const { return _attackedBy[side == WHITE ? 0 : 1][type]; }
+    // own pieces that can't leave the line between their king and an enemy slider
+    uint64_t pinnedPieces(char side) const;
+    // squares a knight, bishop, rook, queen or king on the square attacks, sliders stopped by occupancy;
+    // the magic tables must have been built by a first init
+    static uint64_t pieceAttacks(ChessPiece type, int square, uint64_t occupancy);
     void shutdown();
 private:
-    const BitBoard generatePawnAttacks(const BitBoard pawns, char color);
+    // every change to state[] during a move goes through these two so the incremental data stays in sync;
+    // removing from an empty square is a no-op because the '0' rows of the tables are zero
+    inline void removePiece(int square) {
+        unsigned char piece = state[square];
+        if (piece != '0') {
+            recordDirty(piece, square, false);
+            --pieceCount;
+        }
+        materialKey -= MaterialUnit[piece];
+        hash ^= ZobristPieces[piece][square];
+        mgScore -= PieceSquareMg[piece][square];
+        egScore -= PieceSquareEg[piece][square];
+        phase -= PiecePhase[piece];
+        if (piece == 'P' || piece == 'p')
+            pawnKey ^= ZobristPieces[piece][square];
+        state[square] = '0';
+    }
+    inline void placePiece(unsigned char piece, int square) {
+        recordDirty(piece, square, true);
+        ++pieceCount;
+        materialKey += MaterialUnit[piece];
+        hash ^= ZobristPieces[piece][square];
+        mgScore += PieceSquareMg[piece][square];
+        egScore += PieceSquareEg[piece][square];
+        phase += PiecePhase[piece];
+        if (piece == 'P' || piece == 'p')
+            pawnKey ^= ZobristPieces[piece][square];
+        else if (piece == 'K')
+            kingSquare[0] = square;
+        else if (piece == 'k')
+            kingSquare[1] = square;
+        state[square] = piece;
+    }
+
+    inline void recordDirty(unsigned char piece, int square, bool added) {
+        DirtyPieces& dirty = dirtyStack[stackPtr];
+        dirty.piece[dirty.count] = piece;
+        dirty.square[dirty.count] = (signed char)square;
+        dirty.added[dirty.count++] = added;
+    }
+
+    void updateBitboards();
     uint64_t generatePawnAttacksBitBoard(int square, char color);
     
     void generateKnightMoves(std::vector<BitMove>& moves, BitBoard knightBoard, uint64_t occupancy);
@@ -143,6 +313,5 @@ private:
     void generatePawnMoveList(std::vector<BitMove>& moves, const BitBoard pawns, const BitBoard emptySquares, const BitBoard enemyPieces, char color);
     void addPawnBitboardMovesToList(std::vector<BitMove>& moves, const BitBoard bitboard, const int shift);
     bool isSquareAttacked(int square, char attackerColor, const BitBoard (&boards)[e_numBitboards]);
-    void filterOutIllegalMoves(std::vector<BitMove>& moves);
 
 };
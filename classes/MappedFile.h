@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file: mmap on POSIX, a file mapping on Windows.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // returns false, leaving nothing mapped, if the file is missing or empty
+    bool open(const std::string& path);
+    void close();
+
+    bool                 isOpen() const { return _data != nullptr; }
+    const unsigned char* data() const { return _data; }
+    size_t               size() const { return _size; }
+
+private:
+    const unsigned char* _data = nullptr;
+    size_t               _size = 0;
+#ifdef _WIN32
+    void* _file    = nullptr;
+    void* _mapping = nullptr;
+#endif
+};
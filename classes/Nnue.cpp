@@ -0,0 +1,361 @@
+#include "Nnue.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <type_traits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+
+static constexpr char NNUE_MAGIC[8] = {'C', 'N', 'N', 'U', 'E', '0', '0', '1'};
+
+template <typename T>
+static bool readArray(std::ifstream& file, std::vector<T>& values, const size_t count) {
+    values.resize(count);
+    file.read(reinterpret_cast<char*>(values.data()), static_cast<std::streamsize>(count * sizeof(T)));
+    return static_cast<bool>(file);
+}
+
+bool NnueNetwork::load(const std::string& path) {
+    _loaded = false;
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+
+    char     magic[8];
+    uint32_t dims[4];
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(dims), sizeof(dims));
+    if (!file || std::memcmp(magic, NNUE_MAGIC, sizeof(magic)) != 0 || dims[0] != NNUE_INPUTS || dims[1] != NNUE_L1 ||
+        dims[2] != NNUE_L2 || dims[3] != NNUE_L3) {
+        std::cerr << "NNUE: " << path << " is not a compatible network" << std::endl;
+        return false;
+    }
+
+    std::vector<int32_t> outBias;
+    const bool ok = readArray(file, _featureBias, NNUE_L1) &&
+        readArray(file, _featureWeights, static_cast<size_t>(NNUE_INPUTS) * NNUE_L1) &&
+        readArray(file, _l1Bias, NNUE_L2) && readArray(file, _l1Weights, NNUE_L2 * 2 * NNUE_L1) &&
+        readArray(file, _l2Bias, NNUE_L3) && readArray(file, _l2Weights, NNUE_L3 * NNUE_L2) &&
+        readArray(file, outBias, 1) && readArray(file, _outWeights, NNUE_L3);
+    if (!ok) {
+        std::cerr << "NNUE: " << path << " is truncated" << std::endl;
+        return false;
+    }
+
+    _outBias = outBias[0];
+    _loaded  = true;
+    return true;
+}
+
+void NnueNetwork::randomize(const uint64_t seed) {
+    std::mt19937_64 random(seed);
+    const auto      fill = [&random](auto& values, const size_t count, const int limit) {
+        std::uniform_int_distribution<int> value(-limit, limit);
+        values.resize(count);
+        for (auto& v : values) {
+            v = static_cast<std::remove_reference_t<decltype(v)>>(value(random));
+        }
+    };
+    // small enough that the accumulators stay within 16 bits and the activations spread over 0..127
+    fill(_featureBias, NNUE_L1, 64);
+    fill(_featureWeights, static_cast<size_t>(NNUE_INPUTS) * NNUE_L1, 32);
+    fill(_l1Bias, NNUE_L2, 1024);
+    fill(_l1Weights, NNUE_L2 * 2 * NNUE_L1, 16);
+    fill(_l2Bias, NNUE_L3, 1024);
+    fill(_l2Weights, NNUE_L3 * NNUE_L2, 64);
+    fill(_outWeights, NNUE_L3, 127);
+    _outBias = 0;
+    _loaded  = true;
+}
+
+//
+// kernels, picked at compile time from the instruction set the file is built for; the scalar ones are the
+// reference the SIMD ones must match exactly, checked by NnueEvaluator::check
+//
+
+const char* NnueEvaluator::kernels() {
+#if defined(__AVX2__)
+    return "AVX2";
+#elif defined(__SSE4_1__)
+    return "SSE4.1";
+#else
+    return "scalar";
+#endif
+}
+
+static inline void addColumnScalar(int16_t* acc, const int16_t* column) {
+    for (int i = 0; i < NNUE_L1; i++) {
+        acc[i] = static_cast<int16_t>(acc[i] + column[i]);
+    }
+}
+
+static inline void subColumnScalar(int16_t* acc, const int16_t* column) {
+    for (int i = 0; i < NNUE_L1; i++) {
+        acc[i] = static_cast<int16_t>(acc[i] - column[i]);
+    }
+}
+
+static inline int32_t dotProductScalar(const uint8_t* input, const int8_t* weights, const int size) {
+    int32_t sum = 0;
+    for (int i = 0; i < size; i++) {
+        sum += static_cast<int32_t>(input[i]) * weights[i];
+    }
+    return sum;
+}
+
+static inline void addColumn(int16_t* acc, const int16_t* column) {
+#if defined(__AVX2__)
+    for (int i = 0; i < NNUE_L1; i += 16) {
+        const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc + i));
+        const __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(column + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc + i), _mm256_add_epi16(a, c));
+    }
+#elif defined(__SSE4_1__)
+    for (int i = 0; i < NNUE_L1; i += 8) {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(acc + i));
+        const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(column + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(acc + i), _mm_add_epi16(a, c));
+    }
+#else
+    addColumnScalar(acc, column);
+#endif
+}
+
+static inline void subColumn(int16_t* acc, const int16_t* column) {
+#if defined(__AVX2__)
+    for (int i = 0; i < NNUE_L1; i += 16) {
+        const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc + i));
+        const __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(column + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc + i), _mm256_sub_epi16(a, c));
+    }
+#elif defined(__SSE4_1__)
+    for (int i = 0; i < NNUE_L1; i += 8) {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(acc + i));
+        const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(column + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(acc + i), _mm_sub_epi16(a, c));
+    }
+#else
+    subColumnScalar(acc, column);
+#endif
+}
+
+// dot product of unsigned 8-bit activations (0..127) with signed 8-bit weights; size is a multiple of 32
+static inline int32_t dotProduct(const uint8_t* input, const int8_t* weights, const int size) {
+#if defined(__AVX2__)
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i       sum  = _mm256_setzero_si256();
+    for (int i = 0; i < size; i += 32) {
+        const __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input + i));
+        const __m256i w  = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(weights + i));
+        // activations are at most 127, so the pairwise 16-bit sums cannot saturate
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_maddubs_epi16(in, w), ones));
+    }
+    const __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    const __m128i quad = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+    return _mm_cvtsi128_si32(_mm_add_epi32(quad, _mm_shuffle_epi32(quad, _MM_SHUFFLE(2, 3, 0, 1))));
+#elif defined(__SSE4_1__)
+    const __m128i ones = _mm_set1_epi16(1);
+    __m128i       sum  = _mm_setzero_si128();
+    for (int i = 0; i < size; i += 16) {
+        const __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+        const __m128i w  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(weights + i));
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_maddubs_epi16(in, w), ones));
+    }
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum);
+#else
+    return dotProductScalar(input, weights, size);
+#endif
+}
+
+// out = clamp((weights * input + bias) >> shift, 0, 127), weights stored row per output
+template <bool Simd>
+static void affineClippedRelu(uint8_t* out, const uint8_t* input, const int8_t* weights, const int32_t* bias,
+                              const int inputs, const int outputs) {
+    for (int o = 0; o < outputs; o++) {
+        const int8_t* row = weights + o * inputs;
+        const int32_t sum = (Simd ? dotProduct(input, row, inputs) : dotProductScalar(input, row, inputs)) + bias[o];
+        out[o]            = static_cast<uint8_t>(std::clamp(sum >> NNUE_WEIGHT_SHIFT, 0, 127));
+    }
+}
+
+//
+// evaluator
+//
+
+static int pieceFeature(const int perspective, int kingSquare, const unsigned char piece, int square) {
+    int type;
+    switch (piece) {
+    case 'P': case 'p': type = 0;
+        break;
+    case 'N': case 'n': type = 1;
+        break;
+    case 'B': case 'b': type = 2;
+        break;
+    case 'R': case 'r': type = 3;
+        break;
+    default: type = 4;
+        break;
+    }
+
+    // black sees the board flipped, so both perspectives share the same weights
+    const bool whitePiece = piece < 'a';
+    if (perspective == 1) {
+        square ^= 56;
+        kingSquare ^= 56;
+    }
+    const bool own = whitePiece == (perspective == 0);
+    return kingSquare * NNUE_PIECE_FEATURES + ((own ? 0 : 5) + type) * 64 + square;
+}
+
+static bool isKing(const unsigned char piece) {
+    return piece == 'K' || piece == 'k';
+}
+
+NnueEvaluator::NnueEvaluator(const NnueNetwork& network)
+    : _network(network) {
+    std::memset(_stack, 0, sizeof(_stack));
+}
+
+void NnueEvaluator::refresh(const GameStateData& board, const uint64_t serial, const int level, const int perspective) {
+    ++_refreshes;
+    int16_t*  acc        = _stack[level].values[perspective];
+    const int kingSquare = board.kingSquare[perspective];
+    std::memcpy(acc, _network._featureBias.data(), sizeof(int16_t) * NNUE_L1);
+
+    for (int square = 0; square < 64; square++) {
+        const unsigned char piece = board.state[square];
+        if (piece == '0' || isKing(piece)) {
+            continue;
+        }
+        const int feature = pieceFeature(perspective, kingSquare, piece, square);
+        addColumn(acc, &_network._featureWeights[static_cast<size_t>(feature) * NNUE_L1]);
+    }
+    _stack[level].serial[perspective] = serial;
+}
+
+void NnueEvaluator::updateAccumulator(const GameState& state, const int perspective) {
+    const int           level   = state.stackPtr;
+    const unsigned char ownKing = perspective == 0 ? 'K' : 'k';
+
+    // Walk down to the nearest level that is still valid for this line. If our king moved on the way, or
+    // nothing is valid, rebuild the lowest level that needs it (stateStack[l] is the board at level l) so
+    // sibling lines can build on it too.
+    int base = level;
+    while (_stack[base].serial[perspective] != state.dirtyStack[base].serial) {
+        const DirtyPieces& dirty     = state.dirtyStack[base];
+        bool               kingMoved = base == 0;
+        for (int i = 0; i < dirty.count && !kingMoved; i++) {
+            kingMoved = dirty.piece[i] == ownKing;
+        }
+        if (kingMoved) {
+            const GameStateData& board = base == level ? static_cast<const GameStateData&>(state) : state.stateStack[base];
+            refresh(board, dirty.serial, base, perspective);
+            break;
+        }
+        --base;
+    }
+
+    // our king didn't move above base, so today's king square is the one every level in between used
+    const int kingSquare = state.kingSquare[perspective];
+    for (int l = base + 1; l <= level; l++) {
+        ++_updates;
+        int16_t* acc = _stack[l].values[perspective];
+        std::memcpy(acc, _stack[l - 1].values[perspective], sizeof(int16_t) * NNUE_L1);
+
+        const DirtyPieces& dirty = state.dirtyStack[l];
+        for (int i = 0; i < dirty.count; i++) {
+            if (isKing(dirty.piece[i])) {
+                continue;
+            }
+            const int      feature = pieceFeature(perspective, kingSquare, dirty.piece[i], dirty.square[i]);
+            const int16_t* column  = &_network._featureWeights[static_cast<size_t>(feature) * NNUE_L1];
+            if (dirty.added[i]) {
+                addColumn(acc, column);
+            }
+            else {
+                subColumn(acc, column);
+            }
+        }
+        _stack[l].serial[perspective] = dirty.serial;
+    }
+}
+
+int NnueEvaluator::evaluate(const GameState& state) {
+    const int level = state.stackPtr;
+    for (int perspective = 0; perspective < 2; perspective++) {
+        if (_stack[level].serial[perspective] != state.dirtyStack[level].serial) {
+            updateAccumulator(state, perspective);
+        }
+    }
+
+    // side to move's half first
+    const int stm = state.color == WHITE ? 0 : 1;
+    return propagate<true>(_network, _stack[level].values[stm], _stack[level].values[stm ^ 1]);
+}
+
+template <bool Simd>
+int NnueEvaluator::propagate(const NnueNetwork& network, const int16_t* us, const int16_t* them) {
+    alignas(64) uint8_t input[2 * NNUE_L1];
+    for (int half = 0; half < 2; half++) {
+        const int16_t* acc = half == 0 ? us : them;
+        for (int i = 0; i < NNUE_L1; i++) {
+            input[half * NNUE_L1 + i] = static_cast<uint8_t>(std::clamp<int>(acc[i], 0, 127));
+        }
+    }
+
+    alignas(64) uint8_t hidden1[NNUE_L2];
+    alignas(64) uint8_t hidden2[NNUE_L3];
+    affineClippedRelu<Simd>(hidden1, input, network._l1Weights.data(), network._l1Bias.data(), 2 * NNUE_L1, NNUE_L2);
+    affineClippedRelu<Simd>(hidden2, hidden1, network._l2Weights.data(), network._l2Bias.data(), NNUE_L2, NNUE_L3);
+
+    const int8_t* out    = network._outWeights.data();
+    const int32_t output = (Simd ? dotProduct(hidden2, out, NNUE_L3) : dotProductScalar(hidden2, out, NNUE_L3)) +
+        network._outBias;
+    return output / NNUE_OUTPUT_SCALE;
+}
+
+int NnueEvaluator::scalarEvaluate(const NnueNetwork& network, const GameState& state) {
+    int16_t acc[2][NNUE_L1];
+    for (int perspective = 0; perspective < 2; perspective++) {
+        std::memcpy(acc[perspective], network._featureBias.data(), sizeof(int16_t) * NNUE_L1);
+        for (int square = 0; square < 64; square++) {
+            const unsigned char piece = state.state[square];
+            if (piece == '0' || isKing(piece)) {
+                continue;
+            }
+            const int feature = pieceFeature(perspective, state.kingSquare[perspective], piece, square);
+            addColumnScalar(acc[perspective], &network._featureWeights[static_cast<size_t>(feature) * NNUE_L1]);
+        }
+    }
+    const int stm = state.color == WHITE ? 0 : 1;
+    return propagate<false>(network, acc[stm], acc[stm ^ 1]);
+}
+
+int NnueEvaluator::check(GameState& state, const int plies, const uint64_t seed) {
+    std::mt19937_64 random(seed);
+    int             mismatches = 0;
+    int             played     = 0;
+    for (; played <= plies; played++) {
+        mismatches += evaluate(state) != scalarEvaluate(_network, state);
+        const std::vector<BitMove> moves = state.generateAllMoves();
+        if (played == plies || moves.empty()) {
+            break;
+        }
+        state.pushMove(moves[random() % moves.size()]);
+    }
+    // taking the line back evaluates every level again from accumulators computed on the way down
+    for (; played > 0; played--) {
+        state.popState();
+        mismatches += evaluate(state) != scalarEvaluate(_network, state);
+    }
+    return mismatches;
+}
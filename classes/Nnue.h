@@ -0,0 +1,86 @@
+#pragma once
+
+#include "GameState.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// HalfKP: for each side's point of view, every non-king piece feature is paired with that side's king square
+constexpr int NNUE_PIECE_FEATURES = 10 * 64; // own and enemy pawn..queen on each square
+constexpr int NNUE_INPUTS         = 64 * NNUE_PIECE_FEATURES;
+constexpr int NNUE_L1             = 256; // accumulator width per perspective
+constexpr int NNUE_L2             = 32;
+constexpr int NNUE_L3             = 32;
+
+// hidden layer outputs are scaled down by 2^NNUE_WEIGHT_SHIFT, the final output by NNUE_OUTPUT_SCALE to centipawns
+constexpr int NNUE_WEIGHT_SHIFT = 6;
+constexpr int NNUE_OUTPUT_SCALE = 16;
+
+//
+// Quantized network weights. The file is little endian:
+//   "CNNUE001", uint32 inputs, L1, L2, L3 (must match the constants above)
+//   int16 feature bias[L1], int16 feature weights[inputs][L1]
+//   int32 bias[L2], int8 weights[L2][2 * L1]
+//   int32 bias[L3], int8 weights[L3][L2]
+//   int32 output bias, int8 output weights[L3]
+//
+class NnueNetwork {
+public:
+    // returns false, leaving the network unloaded, if the file is missing or malformed
+    bool load(const std::string& path);
+    bool loaded() const { return _loaded; }
+    // random weights of plausible magnitude, for checking the kernels and timing inference without a network file
+    void randomize(uint64_t seed);
+
+private:
+    friend class NnueEvaluator;
+
+    bool                 _loaded = false;
+    std::vector<int16_t> _featureWeights; // [NNUE_INPUTS][NNUE_L1]
+    std::vector<int16_t> _featureBias;
+    std::vector<int8_t>  _l1Weights;      // [NNUE_L2][2 * NNUE_L1]
+    std::vector<int32_t> _l1Bias;
+    std::vector<int8_t>  _l2Weights;      // [NNUE_L3][NNUE_L2]
+    std::vector<int32_t> _l2Bias;
+    std::vector<int8_t>  _outWeights;
+    int32_t              _outBias = 0;
+};
+
+struct alignas(64) NnueAccumulator {
+    int16_t  values[2][NNUE_L1]; // white's and black's perspective
+    uint64_t serial[2];          // DirtyPieces::serial of the stack level each perspective was computed for
+};
+
+// Per-thread evaluator. Its accumulator stack mirrors GameState's state stack: each level is derived from
+// the level below by adding and removing the feature columns of that level's DirtyPieces, and only rebuilt
+// from scratch when the perspective's own king moved.
+class NnueEvaluator {
+public:
+    explicit NnueEvaluator(const NnueNetwork& network);
+
+    // score from the point of view of the side to move
+    int evaluate(const GameState& state);
+
+    // Plays a random line of up to plies moves from state and back, comparing every evaluate() with
+    // scalarEvaluate(). Returns the number that differed, 0 when the SIMD kernels and the incremental updates
+    // agree with the scalar reference. state is left as it was.
+    int check(GameState& state, int plies, uint64_t seed);
+    // the instruction set the kernels were built for: "AVX2", "SSE4.1" or "scalar"
+    static const char* kernels();
+    // the accumulators rebuilt from scratch and the layers run with the portable scalar kernels
+    static int scalarEvaluate(const NnueNetwork& network, const GameState& state);
+
+    uint64_t refreshes() const { return _refreshes; }
+    uint64_t updates() const { return _updates; }
+
+private:
+    void updateAccumulator(const GameState& state, int perspective);
+    void refresh(const GameStateData& board, uint64_t serial, int level, int perspective);
+    template <bool Simd>
+    static int propagate(const NnueNetwork& network, const int16_t* us, const int16_t* them);
+
+    const NnueNetwork& _network;
+    NnueAccumulator    _stack[MAX_DEPTH + 1];
+    uint64_t           _refreshes = 0;
+    uint64_t           _updates   = 0;
+};
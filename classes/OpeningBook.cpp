@@ -0,0 +1,184 @@
+#include "OpeningBook.h"
+#include "PolyglotRandom.h"
+#include <cstring>
+
+uint64_t polyglotKey(const GameState& state) {
+    static const char* const kinds = "pPnNbBrRqQkK";
+    uint64_t key = 0;
+    for (int square = 0; square < 64; square++) {
+        if (state.state[square] != '0') {
+            const int kind = static_cast<int>(std::strchr(kinds, state.state[square]) - kinds);
+            key ^= POLYGLOT_RANDOM[POLYGLOT_RANDOM_PIECE + 64 * kind + square];
+        }
+    }
+
+    // a right survives as long as neither the king nor that rook has left its square
+    const auto castle = [&](const int king, const int rook, const char kingPiece, const char rookPiece, const int entry) {
+        if (state.state[king] == kingPiece && state.state[rook] == rookPiece) {
+            key ^= POLYGLOT_RANDOM[POLYGLOT_RANDOM_CASTLE + entry];
+        }
+    };
+    castle(4, 7, 'K', 'R', 0);
+    castle(4, 0, 'K', 'R', 1);
+    castle(60, 63, 'k', 'r', 2);
+    castle(60, 56, 'k', 'r', 3);
+
+    if (state.doublePushFile >= 0) {
+        const int  file     = state.doublePushFile;
+        const int  rank     = state.color == WHITE ? 4 : 3;
+        const char capturer = state.color == WHITE ? 'P' : 'p';
+        if ((file > 0 && state.state[rank * 8 + file - 1] == capturer) ||
+            (file < 7 && state.state[rank * 8 + file + 1] == capturer)) {
+            key ^= POLYGLOT_RANDOM[POLYGLOT_RANDOM_EN_PASSANT + file];
+        }
+    }
+
+    if (state.color == WHITE) {
+        key ^= POLYGLOT_RANDOM[POLYGLOT_RANDOM_TURN];
+    }
+    return key;
+}
+
+bool OpeningBook::open(const std::string& path) {
+    close();
+    if (!_file.open(path)) {
+        return false;
+    }
+    if (_file.size() % BOOK_ENTRY_SIZE != 0) {
+        _file.close();
+        return false;
+    }
+    _data  = _file.data();
+    _count = _file.size() / BOOK_ENTRY_SIZE;
+    return true;
+}
+
+void OpeningBook::close() {
+    _file.close();
+    _data  = nullptr;
+    _count = 0;
+}
+
+static uint64_t readBigEndian(const unsigned char* in, const int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+static void writeBigEndian(unsigned char* out, uint64_t value, const int bytes) {
+    for (int i = bytes - 1; i >= 0; i--) {
+        out[i] = static_cast<unsigned char>(value & 0xFF);
+        value >>= 8;
+    }
+}
+
+BookEntry OpeningBook::readEntry(const unsigned char* in) {
+    BookEntry entry;
+    entry.key    = readBigEndian(in, 8);
+    entry.move   = static_cast<uint16_t>(readBigEndian(in + 8, 2));
+    entry.weight = static_cast<uint16_t>(readBigEndian(in + 10, 2));
+    entry.learn  = static_cast<uint32_t>(readBigEndian(in + 12, 4));
+    return entry;
+}
+
+void OpeningBook::writeEntry(unsigned char* out, const BookEntry& entry) {
+    writeBigEndian(out, entry.key, 8);
+    writeBigEndian(out + 8, entry.move, 2);
+    writeBigEndian(out + 10, entry.weight, 2);
+    writeBigEndian(out + 12, entry.learn, 4);
+}
+
+uint16_t OpeningBook::encodeMove(const BitMove& move) {
+    int to        = move.to;
+    int promotion = 0;
+    if (move.flags & KingSideCastle) {
+        to = move.from + 3;
+    }
+    else if (move.flags & QueenSideCastle) {
+        to = move.from - 4;
+    }
+    else if ((move.flags & IsPromotion) || (move.piece == Pawn && (move.to < 8 || move.to >= 56))) {
+        promotion = 4;
+    }
+    return static_cast<uint16_t>((promotion << 12) | (move.from << 6) | to);
+}
+
+void OpeningBook::decodeMove(const uint16_t move, int& from, int& to, int& promotion) {
+    to        = move & 0x3F;
+    from      = (move >> 6) & 0x3F;
+    promotion = (move >> 12) & 0x7;
+}
+
+size_t OpeningBook::lowerBound(const uint64_t key) const {
+    size_t low  = 0;
+    size_t high = _count;
+    while (low < high) {
+        const size_t middle = low + (high - low) / 2;
+        if (readBigEndian(_data + middle * BOOK_ENTRY_SIZE, 8) < key) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+std::vector<BookEntry> OpeningBook::entries(const uint64_t key) const {
+    std::vector<BookEntry> result;
+    if (!_data) {
+        return result;
+    }
+    for (size_t index = lowerBound(key); index < _count; index++) {
+        const BookEntry entry = readEntry(_data + index * BOOK_ENTRY_SIZE);
+        if (entry.key != key) {
+            break;
+        }
+        result.push_back(entry);
+    }
+    return result;
+}
+
+bool OpeningBook::pickMove(GameState& state, BitMove& move) {
+    const std::vector<BookEntry> candidates = entries(polyglotKey(state));
+    if (candidates.empty()) {
+        return false;
+    }
+
+    // only moves the engine can play here; a book entry it can't is skipped
+    std::vector<BitMove>  moves;
+    std::vector<uint32_t> weights;
+    for (const BookEntry& entry : candidates) {
+        int from, to, promotion;
+        decodeMove(entry.move, from, to, promotion);
+        if (entry.weight == 0 || (promotion != 0 && promotion != 4)) {
+            continue;
+        }
+        const char piece = state.state[from];
+        if ((piece == 'K' || piece == 'k') && from % 8 == 4 && to / 8 == from / 8 && (to % 8 == 0 || to % 8 == 7)) {
+            // castling: the generator has none, so check here that the king doesn't leave, cross or land on
+            // an attacked square
+            const int step = to > from ? 1 : -1;
+            to = from + 2 * step;
+            state.updateAttackMaps();
+            const uint64_t path = (1ULL << from) | (1ULL << (from + step)) | (1ULL << to);
+            if (state._attackBitBoard.getData() & path) {
+                continue;
+            }
+        }
+        BitMove candidate;
+        if (state.moveFromUci(GameState::moveToUci(BitMove(from, to, NoPiece)), candidate)) {
+            moves.push_back(candidate);
+            weights.push_back(entry.weight);
+        }
+    }
+    if (moves.empty()) {
+        return false;
+    }
+
+    std::discrete_distribution<size_t> pick(weights.begin(), weights.end());
+    move = moves[pick(_rng)];
+    return true;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "GameState.h"
+#include "MappedFile.h"
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+// One book entry. On disk it is 16 bytes, big endian, sorted by key: the Polyglot .bin record.
+struct BookEntry {
+    uint64_t key;    // polyglotKey of the position
+    uint16_t move;   // to square in bits 0-5, from square in bits 6-11, promotion piece in bits 12-14
+    uint16_t weight; // relative frequency of the move among the position's entries
+    uint32_t learn;
+};
+
+constexpr size_t BOOK_ENTRY_SIZE = 16;
+
+// The Polyglot key of the position. The state tracks neither castling rights nor an en passant square, so the
+// rights are inferred from kings and rooks still on their starting squares, and the en passant file comes from
+// the last move's double pawn push and counts only if a pawn of the side to move stands beside it.
+uint64_t polyglotKey(const GameState& state);
+
+//
+// Read-only Polyglot opening book, memory mapped so opening it costs nothing and a probe is a binary search over
+// the file. Reads any standard .bin book as well as the ones chess-book writes.
+//
+class OpeningBook {
+public:
+    // returns false, leaving the book closed, if the file is missing or not a whole number of entries
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const { return _data != nullptr; }
+    size_t size() const { return _count; }
+
+    // every entry for the position, in file order
+    std::vector<BookEntry> entries(uint64_t key) const;
+    // picks one of the position's legal book moves with probability proportional to its weight; underpromotions
+    // are skipped, since the engine only promotes to a queen
+    bool pickMove(GameState& state, BitMove& move);
+
+    // Polyglot move encoding: squares are rank * 8 + file on both sides, castling is the king taking its own
+    // rook and the promotion piece is 1-4 for knight to queen
+    static uint16_t encodeMove(const BitMove& move);
+    static void     decodeMove(uint16_t move, int& from, int& to, int& promotion);
+    static void     writeEntry(unsigned char* out, const BookEntry& entry);
+    static BookEntry readEntry(const unsigned char* in);
+
+private:
+    // index of the first entry whose key is not less than key
+    size_t lowerBound(uint64_t key) const;
+
+    MappedFile           _file;
+    const unsigned char* _data  = nullptr;
+    size_t               _count = 0;
+    std::mt19937         _rng{std::random_device{}()};
+};
@@ -0,0 +1,145 @@
+#include "PerfCounters.h"
+#include <sstream>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+static const char* PERF_EVENT_NAMES[PerfEventCount] = {
+    "cycles", "instructions", "l1d-misses", "llc-misses", "branch-misses", "dtlb-misses",
+};
+
+double PerfSample::ipc() const {
+    if (!valid[PerfCycles] || !valid[PerfInstructions] || value[PerfCycles] == 0) {
+        return 0;
+    }
+    return static_cast<double>(value[PerfInstructions]) / value[PerfCycles];
+}
+
+std::string PerfSample::describe(const uint64_t nodes) const {
+    std::ostringstream text;
+    bool               any = false;
+    for (int event = 0; event < PerfEventCount; event++) {
+        if (!valid[event]) {
+            continue;
+        }
+        text << (any ? " " : "") << PERF_EVENT_NAMES[event] << " " << value[event];
+        if (nodes > 0 && event >= PerfL1dMisses) {
+            text << " (" << static_cast<double>(value[event]) / nodes << "/node)";
+        }
+        any = true;
+    }
+    if (!any) {
+        return "no hardware counters";
+    }
+    if (valid[PerfCycles] && valid[PerfInstructions]) {
+        text << " ipc " << ipc();
+    }
+    return text.str();
+}
+
+PerfCounters::PerfCounters() {
+    for (int& fd : _fd) {
+        fd = -1;
+    }
+}
+
+PerfCounters::~PerfCounters() {
+    close();
+}
+
+#ifdef __linux__
+
+static uint64_t cacheEvent(const uint64_t cache, const uint64_t result) {
+    return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (result << 16);
+}
+
+bool PerfCounters::open() {
+    close();
+    const struct {
+        uint32_t type;
+        uint64_t config;
+    } events[PerfEventCount] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HW_CACHE, cacheEvent(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+        {PERF_TYPE_HW_CACHE, cacheEvent(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        {PERF_TYPE_HW_CACHE, cacheEvent(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    };
+
+    bool any = false;
+    for (int event = 0; event < PerfEventCount; event++) {
+        perf_event_attr attr{};
+        attr.size           = sizeof(attr);
+        attr.type           = events[event].type;
+        attr.config         = events[event].config;
+        attr.disabled       = 1;
+        attr.inherit        = 1; // search helpers started while counting are counted too
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+        attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        _fd[event] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        any |= _fd[event] >= 0;
+    }
+    return any;
+}
+
+void PerfCounters::close() {
+    for (int& fd : _fd) {
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+}
+
+void PerfCounters::start() {
+    for (const int fd : _fd) {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+PerfSample PerfCounters::stop() {
+    for (const int fd : _fd) {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+
+    PerfSample sample;
+    for (int event = 0; event < PerfEventCount; event++) {
+        // value, time enabled, time running
+        uint64_t data[3];
+        if (_fd[event] < 0 || read(_fd[event], data, sizeof(data)) != sizeof(data) || data[2] == 0) {
+            continue;
+        }
+        sample.value[event] = data[2] < data[1] ? static_cast<uint64_t>(static_cast<double>(data[0]) * data[1] / data[2]) : data[0];
+        sample.valid[event] = true;
+    }
+    return sample;
+}
+
+#else
+
+bool PerfCounters::open() {
+    return false;
+}
+
+void PerfCounters::close() {
+}
+
+void PerfCounters::start() {
+}
+
+PerfSample PerfCounters::stop() {
+    return PerfSample();
+}
+
+#endif
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+enum PerfEvent {
+    PerfCycles,
+    PerfInstructions,
+    PerfL1dMisses,  // L1 data cache read misses
+    PerfLlcMisses,  // last level cache read misses
+    PerfBranchMisses,
+    PerfDtlbMisses, // data TLB read misses
+    PerfEventCount
+};
+
+// counts of one measured region, scaled up when the kernel had to share the hardware counters between events
+struct PerfSample {
+    uint64_t value[PerfEventCount] = {};
+    bool     valid[PerfEventCount] = {};
+
+    double ipc() const;
+    // every counter that was read, with the IPC, and each miss count per node when nodes isn't 0
+    std::string describe(uint64_t nodes) const;
+};
+
+// Hardware counters from Linux perf_event_open for the calling thread and the threads it starts while they
+// count. Elsewhere, or where the kernel or a virtual machine doesn't expose them, nothing opens and every
+// sample comes back without valid counters.
+class PerfCounters {
+public:
+    PerfCounters();
+    ~PerfCounters();
+    PerfCounters(const PerfCounters&)            = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    // opens every counter the machine allows, false if none
+    bool open();
+    void close();
+
+    // resets and starts the counters
+    void       start();
+    // stops them and reads what they counted since start()
+    PerfSample stop();
+
+private:
+    int _fd[PerfEventCount];
+};
@@ -0,0 +1,756 @@
+#include "Search.h"
+#include "Endgame.h"
+#include "Trace.h"
+#include "AllocTracker.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+#include <thread>
+
+// half width of the first aspiration window around the previous iteration's score
+constexpr int ASPIRATION_DELTA = 25;
+// shallow iterations are too unstable for a narrow window to pay off
+constexpr int ASPIRATION_MIN_DEPTH = 4;
+// history scores saturate towards this value
+constexpr int MAX_HISTORY = 16384;
+// milliseconds kept back from every move for the interface and the pipe
+constexpr int64_t MOVE_OVERHEAD = 30;
+// a sudden death clock is shared out over this many moves
+constexpr int DEFAULT_MOVES_TO_GO = 30;
+// a move may take up to this many times its share of the clock when iterations run long
+constexpr int MAXIMUM_TIME_FACTOR = 4;
+
+static constexpr int pieceTypeOf(const char c) {
+    switch (c) {
+    case 'P': case 'p': return Pawn;
+    case 'N': case 'n': return Knight;
+    case 'B': case 'b': return Bishop;
+    case 'R': case 'r': return Rook;
+    case 'Q': case 'q': return Queen;
+    case 'K': case 'k': return King;
+    default: return NoPiece;
+    }
+}
+
+static bool isCapture(const GameState& state, const BitMove& move) {
+    return state.state[move.to] != '0' || (move.flags & EnPassant);
+}
+
+static bool isQuiet(const GameState& state, const BitMove& move) {
+    return !isCapture(state, move) && !(move.flags & IsPromotion);
+}
+
+static int colorIndex(const char color) {
+    return color == WHITE ? 0 : 1;
+}
+
+void SearchStats::merge(const SearchStats& other) {
+    nodes                 += other.nodes;
+    qnodes                += other.qnodes;
+    ttProbes              += other.ttProbes;
+    ttHits                += other.ttHits;
+    ttCutoffs             += other.ttCutoffs;
+    betaCutoffs           += other.betaCutoffs;
+    pvsReSearches         += other.pvsReSearches;
+    aspirationFailLows    += other.aspirationFailLows;
+    aspirationFailHighs   += other.aspirationFailHighs;
+    nullMoveTries         += other.nullMoveTries;
+    nullMoveCutoffs       += other.nullMoveCutoffs;
+    lmrReductions         += other.lmrReductions;
+    lmrReSearches         += other.lmrReSearches;
+    reverseFutilityPrunes += other.reverseFutilityPrunes;
+    futilityPrunes        += other.futilityPrunes;
+    lateMovePrunes        += other.lateMovePrunes;
+    checkExtensions       += other.checkExtensions;
+    recaptureExtensions   += other.recaptureExtensions;
+    singularSearches      += other.singularSearches;
+    singularExtensions    += other.singularExtensions;
+    pawnTableProbes       += other.pawnTableProbes;
+    pawnTableHits         += other.pawnTableHits;
+    evalCacheProbes       += other.evalCacheProbes;
+    evalCacheHits         += other.evalCacheHits;
+    evalCalls             += other.evalCalls;
+    nnueRefreshes         += other.nnueRefreshes;
+    nnueUpdates           += other.nnueUpdates;
+    tablebaseProbes       += other.tablebaseProbes;
+    tablebaseHits         += other.tablebaseHits;
+    kpkHits               += other.kpkHits;
+    for (int i = 0; i < CUTOFF_INDEX_SLOTS; i++) {
+        cutoffsByMoveIndex[i] += other.cutoffsByMoveIndex[i];
+    }
+}
+
+double SearchStats::branchingFactor(const int index) const {
+    if (index < 1 || index >= iterations) {
+        return 0;
+    }
+    // the node counts are running totals
+    const uint64_t before   = index >= 2 ? iterationNodes[index - 2] : 0;
+    const uint64_t previous = iterationNodes[index - 1] - before;
+    const uint64_t current  = iterationNodes[index] - iterationNodes[index - 1];
+    return previous > 0 ? static_cast<double>(current) / previous : 0;
+}
+
+std::string SearchStats::toJson() const {
+    std::ostringstream json;
+    json << "{\"nodes\":" << nodes << ",\"qnodes\":" << qnodes << ",\"timeMs\":" << time
+         << ",\"nps\":" << nodes * 1000 / std::max<int64_t>(1, time) << ",\"ttProbes\":" << ttProbes
+         << ",\"ttHits\":" << ttHits << ",\"ttCutoffs\":" << ttCutoffs << ",\"betaCutoffs\":" << betaCutoffs
+         << ",\"cutoffsByMoveIndex\":[";
+    for (int i = 0; i < CUTOFF_INDEX_SLOTS; i++) {
+        json << (i ? "," : "") << cutoffsByMoveIndex[i];
+    }
+    json << "],\"nullMoveTries\":" << nullMoveTries << ",\"nullMoveCutoffs\":" << nullMoveCutoffs
+         << ",\"lmrReductions\":" << lmrReductions << ",\"lmrReSearches\":" << lmrReSearches
+         << ",\"pvsReSearches\":" << pvsReSearches << ",\"aspirationFailLows\":" << aspirationFailLows
+         << ",\"aspirationFailHighs\":" << aspirationFailHighs << ",\"reverseFutilityPrunes\":" << reverseFutilityPrunes
+         << ",\"futilityPrunes\":" << futilityPrunes << ",\"lateMovePrunes\":" << lateMovePrunes
+         << ",\"checkExtensions\":" << checkExtensions << ",\"recaptureExtensions\":" << recaptureExtensions
+         << ",\"singularSearches\":" << singularSearches << ",\"singularExtensions\":" << singularExtensions
+         << ",\"pawnTableProbes\":" << pawnTableProbes << ",\"pawnTableHits\":" << pawnTableHits
+         << ",\"evalCacheProbes\":" << evalCacheProbes << ",\"evalCacheHits\":" << evalCacheHits
+         << ",\"evalCalls\":" << evalCalls << ",\"nnueRefreshes\":" << nnueRefreshes << ",\"nnueUpdates\":" << nnueUpdates
+         << ",\"tablebaseProbes\":" << tablebaseProbes << ",\"tablebaseHits\":" << tablebaseHits
+         << ",\"kpkHits\":" << kpkHits << ",\"iterations\":[";
+    for (int i = 0; i < iterations; i++) {
+        json << (i ? "," : "") << "{\"nodes\":" << iterationNodes[i] << ",\"timeMs\":" << iterationTime[i]
+             << ",\"ebf\":" << branchingFactor(i) << "}";
+    }
+    json << "]}";
+    return json.str();
+}
+
+Search::Search()
+    : Search(std::make_shared<TranspositionTable>()) { }
+
+Search::Search(const std::shared_ptr<TranspositionTable>& tt)
+    : _tt(tt) {
+    std::memset(_history, 0, sizeof(_history));
+    std::memset(_lmrTable, 0, sizeof(_lmrTable));
+    std::memset(_captureSquare, -1, sizeof(_captureSquare));
+}
+
+void Search::setNetwork(const NnueNetwork* network) {
+    _network = network;
+    _nnue.reset(network && network->loaded() ? new NnueEvaluator(*network) : nullptr);
+    _evalCache.clear();
+}
+
+void Search::setThreads(const int count) {
+    _helpers.clear();
+    for (int i = 1; i < count; i++) {
+        _helpers.emplace_back(new Search(_tt));
+        _helpers.back()->_main = this;
+    }
+}
+
+int64_t Search::elapsed() const {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - _start).count();
+}
+
+uint64_t Search::totalNodes() const {
+    uint64_t nodes = _stats.nodes;
+    for (const auto& helper : _helpers) {
+        nodes += helper->_publishedNodes.load(std::memory_order_relaxed);
+    }
+    return nodes;
+}
+
+void Search::pollLimits() {
+    if (_main) {
+        _publishedNodes.store(_stats.nodes, std::memory_order_relaxed);
+        _stopped = _main->_abort.load(std::memory_order_relaxed);
+        return;
+    }
+    if (_pondering && _ponderhit.load(std::memory_order_relaxed)) {
+        _pondering  = false;
+        _clockStart = elapsed();
+    }
+    const bool outOfTime = !_pondering && _maximumTime > 0 && elapsed() - _clockStart >= _maximumTime;
+    if (_stop.load(std::memory_order_relaxed) || outOfTime || (_limits.nodes > 0 && totalNodes() >= _limits.nodes)) {
+        _abort.store(true, std::memory_order_relaxed);
+    }
+    _stopped = _abort.load(std::memory_order_relaxed);
+}
+
+int Search::evaluate(GameState& state) {
+    int score;
+    if (_evalCache.probe(state.hash, score)) {
+        return score;
+    }
+    SEARCH_STAT(evalCalls);
+    if (!_nnue) {
+        score = evaluateBoard(state, _pawnTable);
+    }
+    // the network hasn't learned the technique of the known endgames, their rules go first
+    else if (!evaluateEndgame(state, score)) {
+        score = _nnue->evaluate(state);
+    }
+    _evalCache.store(state.hash, score);
+    return score;
+}
+
+// TT move first, then captures by most valuable victim / least valuable attacker, then quiet moves by history
+void Search::orderMoves(const GameState& state, std::vector<BitMove>& moves, const BitMove& ttMove) const {
+    int scores[256];
+    const int count = static_cast<int>(moves.size());
+    const int side  = colorIndex(state.color);
+
+    for (int i = 0; i < count; i++) {
+        const BitMove& move = moves[i];
+        if (move == ttMove) {
+            scores[i] = 4 * MAX_HISTORY;
+        }
+        else if (isCapture(state, move)) {
+            const int victim = (move.flags & EnPassant) ? Pawn : pieceTypeOf(state.state[move.to]);
+            scores[i]        = 2 * MAX_HISTORY + victim * 8 - move.piece;
+        }
+        else {
+            scores[i] = _history[side][move.from][move.to];
+        }
+    }
+
+    // move lists are short, insertion sort beats std::sort here
+    for (int i = 1; i < count; i++) {
+        const BitMove move  = moves[i];
+        const int     score = scores[i];
+        int           j     = i - 1;
+        while (j >= 0 && scores[j] < score) {
+            moves[j + 1]  = moves[j];
+            scores[j + 1] = scores[j];
+            --j;
+        }
+        moves[j + 1]  = move;
+        scores[j + 1] = score;
+    }
+}
+
+void Search::updateHistory(const GameState& state, const BitMove& move, const int bonus) {
+    int& entry = _history[colorIndex(state.color)][move.from][move.to];
+    entry += bonus - entry * std::abs(bonus) / MAX_HISTORY;
+}
+
+int Search::quiesce(GameState& state, int alpha, const int beta, const int ply) {
+    countNode(ply);
+    SEARCH_STAT(qnodes);
+    int known;
+    if (evaluateKpk(state, known)) {
+        SEARCH_STAT(kpkHits);
+        return known;
+    }
+    const int standPat = evaluate(state);
+    if (ply >= MAX_DEPTH || standPat >= beta) {
+        return standPat;
+    }
+    alpha = std::max(alpha, standPat);
+
+    // captures the attack maps show giving up material can't lift a stand pat score on their own
+    auto moves = state.generateAllMoves();
+    moves.erase(std::remove_if(moves.begin(), moves.end(), [&](const BitMove& move) {
+        return !isCapture(state, move) || state.captureLosesMaterial(move);
+    }), moves.end());
+    orderMoves(state, moves);
+
+    int bestVal = standPat;
+    for (const auto& move : moves) {
+        state.pushMove(move);
+        const int val = -quiesce(state, -beta, -alpha, ply + 1);
+        state.popState();
+        if (_stopped) {
+            return 0;
+        }
+
+        if (val > bestVal) {
+            bestVal = val;
+            alpha   = std::max(alpha, val);
+            if (alpha >= beta) {
+                break;
+            }
+        }
+    }
+
+    return bestVal;
+}
+
+int Search::negamax(GameState& state, const int depth, int alpha, const int beta, const int ply, const bool allowNull,
+                    const BitMove& excluded) {
+    // a repeated position can be repeated again, so it is scored as the draw it leads to
+    if (state.isFiftyMoveDraw() || state.isRepetition()) return 0;
+    if (depth <= 0) return quiesce(state, alpha, beta, ply);
+    countNode(ply);
+    if (ply >= MAX_DEPTH) return evaluate(state);
+    // king and pawn against king is decided by the bitbase, nothing below this node can change it
+    int known;
+    if (evaluateKpk(state, known)) {
+        SEARCH_STAT(kpkHits);
+        return known;
+    }
+
+    const bool pvNode      = beta - alpha > 1;
+    const bool singularRun = excluded.piece != NoPiece;
+    const int  alphaOrig   = alpha;
+
+    // a singular verification search shares the position with its parent, so the parent's entry doesn't apply
+    TTEntry    ttEntry{};
+    if (!singularRun) SEARCH_STAT(ttProbes);
+    const bool ttHit   = !singularRun && _tt->probe(state.hash, ttEntry);
+    const int  ttScore = ttHit ? TranspositionTable::scoreFromTT(ttEntry.score, ply) : 0;
+    if (ttHit) SEARCH_STAT(ttHits);
+    if (ttHit && !pvNode && ttEntry.depth >= depth) {
+        if ((ttEntry.bound == TTExact) || (ttEntry.bound == TTLower && ttScore >= beta) ||
+            (ttEntry.bound == TTUpper && ttScore <= alpha)) {
+            SEARCH_STAT(ttCutoffs);
+            return ttScore;
+        }
+    }
+    const BitMove ttMove = ttHit ? ttEntry.move : BitMove();
+
+    // the table result is exact whatever the depth, so it is stored to be trusted by any later search
+    if (_tablebases && !singularRun && state.pieceCount <= std::min(_params.tablebaseProbePieces, _tablebases->maxPieces())) {
+        SEARCH_STAT(tablebaseProbes);
+        TBResult result;
+        if (_tablebases->probeWdl(state, result)) {
+            SEARCH_STAT(tablebaseHits);
+            const int val = result == TBWin ? SCORE_TB_WIN - ply : result == TBLoss ? -SCORE_TB_WIN + ply : 0;
+            _tt->store(state.hash, TranspositionTable::scoreToTT(val, ply), BitMove(), MAX_DEPTH - 1, TTExact);
+            return val;
+        }
+    }
+
+    const bool inCheck    = state.inCheck();
+    const int  staticEval = inCheck ? -SCORE_INFINITE : evaluate(state);
+
+    if (!pvNode && !inCheck && !singularRun && std::abs(beta) < SCORE_TB_BOUND) {
+        if (depth <= _params.reverseFutilityMaxDepth && staticEval - _params.reverseFutilityMargin * depth >= beta) {
+            SEARCH_STAT(reverseFutilityPrunes);
+            return staticEval;
+        }
+
+        if (allowNull && depth >= _params.nullMoveMinDepth && staticEval >= beta &&
+            state.hasNonPawnMaterial(state.color)) {
+            const int reduction = _params.nullMoveReduction + depth / _params.nullMoveDepthDivisor;
+            SEARCH_STAT(nullMoveTries);
+            _captureSquare[ply] = -1;
+            state.pushNullMove();
+            const int val = -negamax(state, depth - 1 - reduction, -beta, -beta + 1, ply + 1, false);
+            state.popState();
+            if (_stopped) {
+                return 0;
+            }
+            if (val >= beta) {
+                SEARCH_STAT(nullMoveCutoffs);
+                return val >= SCORE_TB_BOUND ? beta : val;
+            }
+        }
+    }
+
+    auto moves = state.generateAllMoves();
+    if (moves.empty()) {
+        return inCheck ? -SCORE_MATE + ply : 0;
+    }
+    orderMoves(state, moves, ttMove);
+
+    const bool futile = !pvNode && !inCheck && depth <= _params.futilityMaxDepth &&
+        staticEval + _params.futilityMarginBase + _params.futilityMarginDepth * depth <= alpha;
+    const int  lateMoveLimit = _params.lateMovePruningBase + depth * depth;
+    const bool canExtend     = ply < _params.extensionPlyBudget * _rootDepth;
+
+    int     bestVal     = -SCORE_INFINITE;
+    BitMove bestMove;
+    int     quietsTried = 0;
+    int     searched    = 0;
+    for (int i = 0; i < static_cast<int>(moves.size()); i++) {
+        const BitMove& move = moves[i];
+        if (singularRun && move == excluded) {
+            continue;
+        }
+        const bool quiet   = isQuiet(state, move);
+        const bool capture = !quiet && isCapture(state, move);
+
+        // never prune before one move has a real score, or every move could be pruned away
+        if (quiet && !pvNode && !inCheck && bestVal > -SCORE_TB_BOUND) {
+            if (depth <= _params.lateMovePruningMaxDepth && quietsTried >= lateMoveLimit) {
+                SEARCH_STAT(lateMovePrunes);
+                continue;
+            }
+            if (futile) {
+                SEARCH_STAT(futilityPrunes);
+                continue;
+            }
+        }
+
+        // singular extension: if nothing else comes close to the TT move's score, it is the only move here
+        int extension = 0;
+        if (canExtend && !singularRun && move == ttMove && depth >= _params.singularMinDepth &&
+            ttEntry.depth >= depth - _params.singularTTDepthMargin && (ttEntry.bound & TTLower) &&
+            std::abs(ttScore) < SCORE_TB_BOUND) {
+            const int singularBeta = ttScore - _params.singularMarginPerDepth * depth;
+            SEARCH_STAT(singularSearches);
+            const int val = negamax(state, (depth - 1) / 2, singularBeta - 1, singularBeta, ply, false, move);
+            if (_stopped) {
+                return 0;
+            }
+            if (val < singularBeta) {
+                SEARCH_STAT(singularExtensions);
+                extension = 1;
+            }
+        }
+        if (canExtend && extension == 0 && _params.recaptureExtension && capture && ply > 0 &&
+            _captureSquare[ply - 1] == move.to) {
+            SEARCH_STAT(recaptureExtensions);
+            extension = 1;
+        }
+
+        _captureSquare[ply] = capture ? move.to : -1;
+        state.pushMove(move);
+        const bool givesCheck = state.inCheck();
+        if (canExtend && extension == 0 && _params.checkExtension && givesCheck) {
+            SEARCH_STAT(checkExtensions);
+            extension = 1;
+        }
+        const int newDepth = depth - 1 + extension;
+
+        int val;
+        if (searched == 0) {
+            val = -negamax(state, newDepth, -beta, -alpha, ply + 1, true);
+        }
+        else {
+            int reduction = 0;
+            if (quiet && !inCheck && !givesCheck && depth >= _params.lmrMinDepth && i >= _params.lmrMinMoveIndex) {
+                reduction = _lmrTable[std::min(depth, MAX_DEPTH - 1)][std::min(i, 63)];
+                reduction -= _history[colorIndex(state.color) ^ 1][move.from][move.to] / _params.lmrHistoryDivisor;
+                if (pvNode) --reduction;
+                reduction = std::clamp(reduction, 0, newDepth - 1);
+            }
+
+            if (reduction > 0) {
+                SEARCH_STAT(lmrReductions);
+                val = -negamax(state, newDepth - reduction, -alpha - 1, -alpha, ply + 1, true);
+                if (val > alpha) {
+                    SEARCH_STAT(lmrReSearches);
+                    val = -negamax(state, newDepth, -alpha - 1, -alpha, ply + 1, true);
+                }
+            }
+            else {
+                val = -negamax(state, newDepth, -alpha - 1, -alpha, ply + 1, true);
+            }
+
+            if (val > alpha && val < beta) {
+                SEARCH_STAT(pvsReSearches);
+                val = -negamax(state, newDepth, -beta, -alpha, ply + 1, true);
+            }
+        }
+        state.popState();
+        // an aborted subtree's score means nothing, and must not reach the table
+        if (_stopped) {
+            return 0;
+        }
+        ++searched;
+
+        if (val > bestVal) {
+            bestVal  = val;
+            bestMove = move;
+            alpha    = std::max(alpha, val);
+            if (alpha >= beta) {
+                SEARCH_STAT(betaCutoffs);
+                SEARCH_STAT(cutoffsByMoveIndex[std::min(i, CUTOFF_INDEX_SLOTS - 1)]);
+                if (quiet) {
+                    updateHistory(state, move, depth * depth);
+                    // the quiet moves tried before this one failed to cut, push them down
+                    for (int j = 0; j < i; j++) {
+                        if (isQuiet(state, moves[j])) {
+                            updateHistory(state, moves[j], -depth * depth);
+                        }
+                    }
+                }
+                break;
+            }
+        }
+        if (quiet) ++quietsTried;
+    }
+
+    // every move was excluded or pruned
+    if (searched == 0) {
+        return singularRun ? alpha : staticEval;
+    }
+
+    if (!singularRun) {
+        const TTBound bound = bestVal >= beta ? TTLower : (bestVal > alphaOrig ? TTExact : TTUpper);
+        _tt->store(state.hash, TranspositionTable::scoreToTT(bestVal, ply), bestMove, depth, bound);
+    }
+
+    return bestVal;
+}
+
+int Search::searchRoot(GameState& state, std::vector<BitMove>& moves, const int first, const int depth, int alpha,
+                       const int beta) {
+    countNode(0);
+    int bestVal   = -SCORE_INFINITE;
+    int bestIndex = -1;
+
+    for (int i = first; i < static_cast<int>(moves.size()); i++) {
+        _captureSquare[0] = isCapture(state, moves[i]) ? moves[i].to : -1;
+        state.pushMove(moves[i]);
+        int val;
+        if (i == first) {
+            val = -negamax(state, depth - 1, -beta, -alpha, 1, true);
+        }
+        else {
+            val = -negamax(state, depth - 1, -alpha - 1, -alpha, 1, true);
+            if (val > alpha && val < beta) {
+                SEARCH_STAT(pvsReSearches);
+                val = -negamax(state, depth - 1, -beta, -alpha, 1, true);
+            }
+        }
+        state.popState();
+        if (_stopped) {
+            return 0;
+        }
+
+        if (val > bestVal) {
+            bestVal = val;
+            if (val > alpha) {
+                bestIndex = i;
+                alpha     = val;
+            }
+        }
+        if (alpha >= beta) {
+            break;
+        }
+    }
+
+    // keep the best move first so the next search (re-search or next iteration) opens with the full window on it
+    if (bestIndex > first) {
+        std::rotate(moves.begin() + first, moves.begin() + bestIndex, moves.begin() + bestIndex + 1);
+    }
+
+    return bestVal;
+}
+
+void Search::prepare() {
+    _stats.reset();
+    _pawnTable.resetCounters();
+    _evalCache.resetCounters();
+    _score    = 0;
+    _depth    = 0;
+    _selDepth = 0;
+    _stopped  = false;
+    _publishedNodes.store(0, std::memory_order_relaxed);
+    _nnueRefreshes = _nnue ? _nnue->refreshes() : 0;
+    _nnueUpdates   = _nnue ? _nnue->updates() : 0;
+    std::memset(_history, 0, sizeof(_history));
+
+    for (int depth = 1; depth < MAX_DEPTH; depth++) {
+        for (int index = 1; index < 64; index++) {
+            _lmrTable[depth][index] = static_cast<int>(_params.lmrBase + std::log(depth) * std::log(index) /
+                _params.lmrDivisor);
+        }
+    }
+}
+
+void Search::collectStats() {
+    _stats.pawnTableProbes = _pawnTable.probes();
+    _stats.pawnTableHits   = _pawnTable.hits();
+    _stats.evalCacheProbes = _evalCache.probes();
+    _stats.evalCacheHits   = _evalCache.hits();
+    if (_nnue) {
+        _stats.nnueRefreshes = _nnue->refreshes() - _nnueRefreshes;
+        _stats.nnueUpdates   = _nnue->updates() - _nnueUpdates;
+    }
+}
+
+std::vector<BitMove> Search::principalVariation(GameState& state, const BitMove& rootMove) {
+    std::vector<BitMove> pv{rootMove};
+    state.pushMove(rootMove);
+    TTEntry entry;
+    while (static_cast<int>(pv.size()) < MAX_DEPTH - 1 && !state.isRepetition() && _tt->probe(state.hash, entry)) {
+        auto       moves = state.generateAllMoves();
+        const auto found = std::find(moves.begin(), moves.end(), entry.move);
+        if (found == moves.end()) {
+            break;
+        }
+        pv.push_back(*found);
+        state.pushMove(*found);
+    }
+    for (size_t i = 0; i < pv.size(); i++) {
+        state.popState();
+    }
+    return pv;
+}
+
+// Iterations from 1 to maxDepth; a helper with a depth offset searches one ply deeper than the main thread.
+// With several lines, line k searches the root without the k best moves found before it in this iteration.
+void Search::iterate(GameState& state, std::vector<BitMove>& moves, const int maxDepth, const int depthOffset) {
+    // helpers only help with the best line
+    const int           lineCount = _main ? 1 : std::min(_multiPv, static_cast<int>(moves.size()));
+    std::vector<PvLine> lines(lineCount);
+
+    for (int iteration = 1; iteration <= maxDepth; iteration++) {
+        TRACE_SCOPE("iteration");
+        const int depth = std::min(iteration + depthOffset, MAX_DEPTH - 1);
+        _rootDepth = depth;
+
+        for (int line = 0; line < lineCount; line++) {
+            // each line's window is centred on its own score from the last iteration
+            const int previous = line == 0 ? _score : lines[line].score;
+            int       delta    = ASPIRATION_DELTA;
+            int       alpha    = -SCORE_INFINITE;
+            int       beta     = SCORE_INFINITE;
+            if (depth >= ASPIRATION_MIN_DEPTH) {
+                alpha = std::max(previous - delta, -SCORE_INFINITE);
+                beta  = std::min(previous + delta, SCORE_INFINITE);
+            }
+
+            while (true) {
+                const int val = searchRoot(state, moves, line, depth, alpha, beta);
+                if (_stopped) {
+                    return;
+                }
+
+                if (val <= alpha && alpha > -SCORE_INFINITE) {
+                    SEARCH_STAT(aspirationFailLows);
+                    beta  = (alpha + beta) / 2;
+                    alpha = std::max(val - delta, -SCORE_INFINITE);
+                }
+                else if (val >= beta && beta < SCORE_INFINITE) {
+                    SEARCH_STAT(aspirationFailHighs);
+                    beta = std::min(val + delta, SCORE_INFINITE);
+                }
+                else {
+                    lines[line].score = val;
+                    break;
+                }
+
+                delta += delta / 2;
+            }
+            if (line == 0) {
+                _score = lines[0].score;
+            }
+            // taken now, before the searches of the later lines overwrite the table entries along it
+            if (!_main) {
+                lines[line].pv = principalVariation(state, moves[line]);
+            }
+        }
+
+        _depth = depth;
+        if (_main) {
+            continue;
+        }
+
+        // a later line can come out above an earlier one when its search sees deeper, rank them again
+        if (lineCount > 1) {
+            std::stable_sort(lines.begin(), lines.end(), [](const PvLine& a, const PvLine& b) {
+                return a.score > b.score;
+            });
+            for (int line = 0; line < lineCount; line++) {
+                moves[line] = lines[line].pv.front();
+            }
+            _score = lines[0].score;
+        }
+        _lines = lines;
+        _pv    = lines[0].pv;
+        if constexpr (SEARCH_STATS) {
+            _stats.iterationNodes[_stats.iterations] = totalNodes();
+            _stats.iterationTime[_stats.iterations]  = elapsed();
+            _stats.iterations++;
+        }
+        if (_onIteration) {
+            for (int line = 0; line < lineCount; line++) {
+                SearchInfo info;
+                info.depth    = depth;
+                info.selDepth = _selDepth;
+                info.multiPv  = line + 1;
+                info.score    = lines[line].score;
+                info.nodes    = totalNodes();
+                info.time     = elapsed();
+                info.hashfull = _tt->hashfull();
+                info.pv       = lines[line].pv;
+                info.stats    = &_stats;
+                _onIteration(info);
+            }
+        }
+        pollLimits();
+        // the next iteration takes longer than all before it together, don't start what can't finish
+        if (_stopped || (!_pondering && _optimumTime > 0 && (elapsed() - _clockStart) * 2 >= _optimumTime)) {
+            return;
+        }
+    }
+}
+
+bool Search::think(GameState& state, const int maxDepth, BitMove& bestMove) {
+    SearchLimits limits;
+    limits.depth = maxDepth;
+    return think(state, limits, bestMove);
+}
+
+bool Search::think(GameState& state, const SearchLimits& limits, BitMove& bestMove) {
+    _start  = std::chrono::steady_clock::now();
+    _limits = limits;
+    _abort.store(false, std::memory_order_relaxed);
+    _pondering  = limits.ponder;
+    _clockStart = 0;
+    _pv.clear();
+    _lines.clear();
+    prepare();
+    _tt->newSearch();
+
+    // time for this move: all of a fixed move time, or its share of the clock and a few shares when iterations run long
+    _optimumTime = _maximumTime = 0;
+    const int     side      = colorIndex(state.color);
+    const int64_t remaining = limits.time[side];
+    if (limits.moveTime > 0) {
+        _maximumTime = std::max<int64_t>(1, limits.moveTime - MOVE_OVERHEAD);
+    }
+    else if (remaining > 0) {
+        const int64_t movesToGo = limits.movesToGo > 0 ? limits.movesToGo : DEFAULT_MOVES_TO_GO;
+        const int64_t usable    = std::max<int64_t>(1, remaining - MOVE_OVERHEAD);
+        _optimumTime = std::min(usable, remaining / movesToGo + limits.increment[side] * 3 / 4);
+        _maximumTime = std::min(usable, _optimumTime * MAXIMUM_TIME_FACTOR);
+    }
+
+    auto moves = state.generateAllMoves();
+    if (moves.empty()) {
+        return false;
+    }
+    // with a table for the position only the moves keeping its result are searched, so the search can't
+    // wander from a won ending it can't see to the end of
+    if (_tablebases) {
+        _stats.tablebaseRoot = _tablebases->filterRootMoves(state, moves);
+    }
+    orderMoves(state, moves);
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < _helpers.size(); i++) {
+        Search& helper = *_helpers[i];
+        helper._params     = _params;
+        helper._tablebases = _tablebases;
+        if (helper._network != _network) {
+            helper.setNetwork(_network);
+        }
+        helper.prepare();
+        threads.emplace_back([&helper, position = std::make_unique<GameState>(state), rootMoves = moves,
+                              offset = static_cast<int>(i % 2 == 0)]() mutable {
+            TRACE_THREAD_NAME("search helper");
+            ALLOC_TAG(AllocSearch);
+            helper.iterate(*position, rootMoves, MAX_DEPTH - 1, offset);
+        });
+    }
+
+    iterate(state, moves, limits.depth > 0 ? std::min(limits.depth, MAX_DEPTH - 1) : MAX_DEPTH - 1, 0);
+
+    _abort.store(true, std::memory_order_relaxed);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    collectStats();
+    for (const auto& helper : _helpers) {
+        helper->collectStats();
+        _stats.merge(helper->_stats);
+    }
+    _stats.time = elapsed();
+
+    bestMove = moves.front();
+    return true;
+}
@@ -0,0 +1,300 @@
+#pragma once
+
+#include "GameState.h"
+#include "Evaluate.h"
+#include "Bitbase.h"
+#include "Nnue.h"
+#include "Tablebase.h"
+#include "TranspositionTable.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+constexpr int SCORE_INFINITE = 1000000;
+constexpr int SCORE_MATE     = 100000;
+// any score beyond this is a forced mate found within the search tree
+constexpr int SCORE_MATE_BOUND = SCORE_MATE - MAX_DEPTH;
+// a tablebase win, less the ply it was found at: above any evaluation, below every mate score
+constexpr int SCORE_TB_WIN   = SCORE_MATE / 2;
+// any score beyond this is decided, by a mate or a tablebase, and is kept away from pruning margins
+constexpr int SCORE_TB_BOUND = SCORE_TB_WIN - MAX_DEPTH;
+
+// every forward pruning and reduction threshold in one place so they can be tuned together
+struct SearchParams {
+    // null move: skip our turn and search the opponent's reply with a reduced depth
+    int nullMoveMinDepth     = 3;
+    int nullMoveReduction    = 3;
+    int nullMoveDepthDivisor = 6; // one extra ply of reduction per this many plies of depth
+
+    // late move reductions for quiet moves late in the move list
+    int    lmrMinDepth       = 3;
+    int    lmrMinMoveIndex   = 3;
+    double lmrBase           = 0.75;
+    double lmrDivisor        = 2.25;
+    int    lmrHistoryDivisor = 4096; // one ply less reduction per this much history score
+
+    // reverse futility: static eval so far above beta that a shallow search will not fall below it
+    int reverseFutilityMaxDepth = 6;
+    int reverseFutilityMargin   = 90; // per ply of depth
+
+    // futility: quiet moves cannot raise a static eval this far below alpha
+    int futilityMaxDepth    = 3;
+    int futilityMarginBase  = 100;
+    int futilityMarginDepth = 120;
+
+    // late move pruning: stop trying quiet moves after this many at shallow depth
+    int lateMovePruningMaxDepth = 3;
+    int lateMovePruningBase     = 3; // plus depth * depth
+
+    // extensions are only granted below extensionPlyBudget times the root depth, so forcing lines can't run away
+    int  extensionPlyBudget = 2;
+    bool checkExtension     = true;
+    bool recaptureExtension = true;
+
+    // singular: extend the TT move when every alternative fails low against a margin below its TT score
+    int singularMinDepth       = 6;
+    int singularTTDepthMargin  = 3;
+    int singularMarginPerDepth = 2;
+
+    // probe tablebases inside the tree once this few pieces are left, capped by the largest table loaded
+    int tablebaseProbePieces = TB_MAX_PIECES;
+};
+
+// The counters below compile to nothing in a build configured with CHESS_SEARCH_STATS off; nodes, which the
+// limits are checked against, and the end-of-search table counters are always kept.
+#ifdef CHESS_NO_SEARCH_STATS
+constexpr bool SEARCH_STATS = false;
+#else
+constexpr bool SEARCH_STATS = true;
+#endif
+#define SEARCH_STAT(counter)                          \
+    do {                                              \
+        if constexpr (SEARCH_STATS) ++_stats.counter; \
+    } while (0)
+
+// beta cutoffs are counted by the index of the move that caused them, the last slot taking every later one
+constexpr int CUTOFF_INDEX_SLOTS = 8;
+
+// Counted by each thread on its own and added into the main thread's at the end of think().
+struct SearchStats {
+    uint64_t nodes  = 0;
+    uint64_t qnodes = 0; // quiescence nodes, part of nodes
+
+    uint64_t ttProbes  = 0;
+    uint64_t ttHits    = 0;
+    uint64_t ttCutoffs = 0; // nodes returned straight from the table
+
+    uint64_t betaCutoffs = 0;
+    uint64_t cutoffsByMoveIndex[CUTOFF_INDEX_SLOTS] = {};
+
+    // null-window searches that failed high and had to be searched again with the full window
+    uint64_t pvsReSearches = 0;
+
+    // root searches repeated because the score fell outside the aspiration window
+    uint64_t aspirationFailLows  = 0;
+    uint64_t aspirationFailHighs = 0;
+
+    uint64_t nullMoveTries   = 0;
+    uint64_t nullMoveCutoffs = 0;
+    uint64_t lmrReductions   = 0;
+    uint64_t lmrReSearches   = 0; // reduced moves that beat alpha and were searched again at full depth
+    uint64_t reverseFutilityPrunes = 0;
+    uint64_t futilityPrunes        = 0;
+    uint64_t lateMovePrunes        = 0;
+
+    uint64_t checkExtensions     = 0;
+    uint64_t recaptureExtensions = 0;
+    uint64_t singularSearches    = 0; // excluded-move verification searches
+    uint64_t singularExtensions  = 0;
+
+    uint64_t pawnTableProbes = 0;
+    uint64_t pawnTableHits   = 0;
+
+    uint64_t evalCacheProbes = 0;
+    uint64_t evalCacheHits   = 0;
+
+    uint64_t evalCalls     = 0; // evaluations actually computed, cache hits excluded
+    uint64_t nnueRefreshes = 0; // accumulators rebuilt from scratch rather than updated from the parent's
+    uint64_t nnueUpdates   = 0;
+
+    uint64_t tablebaseProbes = 0;
+    uint64_t tablebaseHits   = 0;
+    bool     tablebaseRoot   = false; // root moves were filtered by the tablebases
+
+    uint64_t kpkHits = 0; // nodes scored by the KPK bitbase instead of being searched
+
+    // completed iterations of the main thread, with the nodes of all threads and the time at the end of each
+    int      iterations = 0;
+    uint64_t iterationNodes[MAX_DEPTH] = {};
+    int64_t  iterationTime[MAX_DEPTH]  = {};
+    int64_t  time = 0; // milliseconds the whole search took
+
+    void reset() { *this = SearchStats(); }
+    // adds a helper thread's counters; the iterations stay the main thread's
+    void merge(const SearchStats& other);
+    // effective branching factor: nodes of the iteration at this index over those of the one before, 0 for the first
+    double branchingFactor(int index) const;
+    // one line, for logs that are compared from build to build
+    std::string toJson() const;
+};
+
+// What ends a search; zero means no limit of that kind. Without any the search runs until stop().
+struct SearchLimits {
+    int      depth        = 0;
+    uint64_t nodes        = 0;
+    int64_t  moveTime     = 0;      // milliseconds for this move
+    int64_t  time[2]      = {0, 0}; // white, black clock in milliseconds
+    int64_t  increment[2] = {0, 0};
+    int      movesToGo    = 0;      // moves to the next time control, 0 for sudden death
+    bool     infinite     = false;
+    bool     ponder       = false;  // searching on the opponent's time: the clock only starts at ponderhit()
+};
+
+// one completed iteration of the main thread
+struct SearchInfo {
+    int                  depth    = 0;
+    int                  selDepth = 0; // deepest ply reached, quiescence included
+    int                  multiPv  = 1; // rank of the line, 1 for the best
+    int                  score    = 0;
+    uint64_t             nodes    = 0; // all threads
+    int64_t              time     = 0; // milliseconds since the search started
+    int                  hashfull = 0;
+    std::vector<BitMove> pv;
+    const SearchStats*   stats    = nullptr; // the main thread's counters so far, valid during the callback
+};
+
+// one line of a multi-PV search
+struct PvLine {
+    int                  score = 0;
+    std::vector<BitMove> pv;
+};
+
+class Search {
+public:
+    Search();
+
+    // iterative deepening up to maxDepth plies, returns false if the side to move has no legal moves
+    bool think(GameState& state, int maxDepth, BitMove& bestMove);
+    // iterative deepening until a limit is reached or stop() is called
+    bool think(GameState& state, const SearchLimits& limits, BitMove& bestMove);
+    // Asks a running think() to return, from another thread, with the best move of the last completed iteration.
+    // A request made before think() starts ends it at once; it stands until resetStop().
+    void stop() { _stop.store(true, std::memory_order_relaxed); }
+    // the opponent played the move a ponder search assumed: it goes on as the real search, its clock starting
+    // now; like stop() it may come before think() starts and stands until resetStop()
+    void ponderhit() { _ponderhit.store(true, std::memory_order_relaxed); }
+    void resetStop() {
+        _stop.store(false, std::memory_order_relaxed);
+        _ponderhit.store(false, std::memory_order_relaxed);
+    }
+    bool stopRequested() const { return _stop.load(std::memory_order_relaxed); }
+
+    // Lazy SMP: count - 1 helper threads search the same root with the shared transposition table,
+    // and the best move is taken from the main thread
+    void setThreads(int count);
+    int  threads() const { return static_cast<int>(_helpers.size()) + 1; }
+    // Multi-PV: report the best this many root moves with their scores and lines instead of only the best. They
+    // share the transposition table, so every line after the first costs a fraction of a search of its own.
+    void setMultiPv(int lines) { _multiPv = std::max(1, lines); }
+    int  multiPv() const { return _multiPv; }
+    // called on the searching thread after every completed iteration, once per line, best first
+    void setInfoCallback(std::function<void(const SearchInfo&)> callback) { _onIteration = std::move(callback); }
+
+    // evaluate with the network instead of the classical evaluation, nullptr to go back; the network must outlive the search
+    void               setNetwork(const NnueNetwork* network);
+    const NnueNetwork* network() const { return _network; }
+    bool               usingNnue() const { return _nnue != nullptr; }
+    // endgame tables probed in the tree and at the root, nullptr for none; they must outlive the search
+    void              setTablebases(const Tablebases* tablebases) { _tablebases = tablebases; }
+    const Tablebases* tablebases() const { return _tablebases; }
+
+    SearchParams&       params() { return _params; }
+    TranspositionTable& tt() { return *_tt; }
+    const SearchStats&  stats() const { return _stats; }
+    int                 score() const { return _score; }
+    int                 depth() const { return _depth; }
+    // principal variation of the last completed iteration, its second move is the reply to ponder on
+    const std::vector<BitMove>& pv() const { return _pv; }
+    // every line of the last completed iteration, best first
+    const std::vector<PvLine>&  lines() const { return _lines; }
+
+private:
+    // a helper sharing the main search's transposition table
+    explicit Search(const std::shared_ptr<TranspositionTable>& tt);
+
+    // clears what one search leaves behind for the next, keeping the transposition table
+    void prepare();
+    // copies the table and evaluator counters into the stats once the search is over
+    void collectStats();
+    void iterate(GameState& state, std::vector<BitMove>& moves, int maxDepth, int depthOffset);
+    // the root move followed by the TT moves, as far as they stay legal and don't repeat
+    std::vector<BitMove> principalVariation(GameState& state, const BitMove& rootMove);
+    // called every NODE_POLL_INTERVAL nodes: the main thread checks the clock and the node limit,
+    // every thread picks up a stop
+    void     pollLimits();
+    uint64_t totalNodes() const;
+    int64_t  elapsed() const;
+    void     countNode(int ply) {
+        if (ply > _selDepth) _selDepth = ply;
+        if ((++_stats.nodes & (NODE_POLL_INTERVAL - 1)) == 0) pollLimits();
+    }
+
+    static constexpr uint64_t NODE_POLL_INTERVAL = 1024;
+
+    // searches moves[first..], the moves before it belong to better lines
+    int searchRoot(GameState& state, std::vector<BitMove>& moves, int first, int depth, int alpha, int beta);
+    int negamax(GameState& state, int depth, int alpha, int beta, int ply, bool allowNull,
+                const BitMove& excluded = BitMove());
+    int quiesce(GameState& state, int alpha, int beta, int ply);
+    int evaluate(GameState& state);
+
+    void orderMoves(const GameState& state, std::vector<BitMove>& moves, const BitMove& ttMove = BitMove()) const;
+    void updateHistory(const GameState& state, const BitMove& move, int bonus);
+
+    SearchParams                        _params;
+    SearchStats                         _stats;
+    std::shared_ptr<TranspositionTable> _tt;
+    PawnTable                           _pawnTable;
+    EvalCache                           _evalCache;
+    std::unique_ptr<NnueEvaluator>      _nnue;
+    uint64_t                            _nnueRefreshes = 0; // the evaluator's counters when the search started
+    uint64_t                            _nnueUpdates   = 0;
+    const NnueNetwork*                  _network    = nullptr;
+    const Tablebases*                   _tablebases = nullptr;
+    int                                 _score      = 0;
+    int                                 _depth      = 0;
+    int                                 _rootDepth  = 0;
+    int                                 _selDepth   = 0;
+    std::vector<BitMove>                _pv;
+    std::vector<PvLine>                 _lines;
+    int                                 _multiPv    = 1;
+
+    // threads: the main search owns the helpers, which follow its _abort
+    std::vector<std::unique_ptr<Search>>   _helpers;
+    Search*                                _main = nullptr; // nullptr for the main search
+    std::atomic<bool>                      _stop{false};    // stop() requests
+    std::atomic<bool>                      _ponderhit{false};
+    std::atomic<bool>                      _abort{false};   // every thread of this search is to return
+    std::atomic<uint64_t>                  _publishedNodes{0}; // a helper's node count as of its last poll
+    bool                                   _stopped = false;   // this thread is unwinding an aborted search
+    SearchLimits                           _limits;
+    std::chrono::steady_clock::time_point  _start;
+    int64_t                                _optimumTime = 0; // no new iteration is started after half of this
+    int64_t                                _maximumTime = 0; // the search is aborted here
+    bool                                   _pondering   = false;
+    int64_t                                _clockStart  = 0; // milliseconds after _start the clock started at
+    std::function<void(const SearchInfo&)> _onIteration;
+
+    // square of the capture made at each ply, -1 for quiet moves, for recapture extensions
+    int _captureSquare[MAX_DEPTH + 1];
+
+    // [color][from][to] score for quiet moves that caused beta cutoffs
+    int _history[2][64][64];
+    // base late move reduction indexed by [depth][move index]
+    int _lmrTable[MAX_DEPTH][64];
+};
@@ -0,0 +1,375 @@
+#include "Tablebase.h"
+#include "Endgame.h"
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+static const char* PIECE_ORDER = "KQRBNP"; // within a side, in signatures and in index order
+
+// pawnless tables keep the white king on a1-d1-d4, numbered in square order
+static const int TRIANGLE_SQUARES[10] = {0, 1, 2, 3, 9, 10, 11, 18, 19, 27};
+
+constexpr int KING_PAIRS_PAWNLESS = 462;
+constexpr int KING_PAIRS_PAWNS    = 1806;
+
+// The legal king placements of both kinds of table, white king in region order, then black king in square order.
+struct KingPairs {
+    int16_t index[2][64][64]; // [pawns][white king][black king], -1 for a placement that isn't indexed
+    uint8_t squares[2][KING_PAIRS_PAWNS][2];
+
+    KingPairs() {
+        std::memset(index, -1, sizeof(index));
+        for (int pawns = 0; pawns < 2; pawns++) {
+            int count = 0;
+            for (int region = 0; region < (pawns ? 32 : 10); region++) {
+                const int white = pawns ? (region / 4) * 8 + region % 4 : TRIANGLE_SQUARES[region];
+                for (int black = 0; black < 64; black++) {
+                    const bool touching = std::abs((white & 7) - (black & 7)) <= 1 && std::abs((white >> 3) - (black >> 3)) <= 1;
+                    const bool aboveDiagonal = !pawns && (white >> 3) == (white & 7) && (black >> 3) > (black & 7);
+                    if (touching || aboveDiagonal) continue;
+                    index[pawns][white][black] = static_cast<int16_t>(count);
+                    squares[pawns][count][0]   = static_cast<uint8_t>(white);
+                    squares[pawns][count][1]   = static_cast<uint8_t>(black);
+                    count++;
+                }
+            }
+            assert(count == (pawns ? KING_PAIRS_PAWNS : KING_PAIRS_PAWNLESS));
+        }
+    }
+};
+
+static const KingPairs KING_PAIRS;
+
+static int pieceValue(const char piece) {
+    switch (std::toupper(piece)) {
+        case 'Q': return 9;
+        case 'R': return 5;
+        case 'B':
+        case 'N': return 3;
+        case 'P': return 1;
+        default:  return 0;
+    }
+}
+
+static int pieceRank(const char piece) {
+    const char* found = std::strchr(PIECE_ORDER, std::toupper(piece));
+    return found ? static_cast<int>(found - PIECE_ORDER) : 6;
+}
+
+// true if side a ("KRP") should be white in the table rather than side b
+static bool strongerSide(const std::string& a, const std::string& b) {
+    int valueA = 0, valueB = 0;
+    for (const char piece : a) valueA += pieceValue(piece);
+    for (const char piece : b) valueB += pieceValue(piece);
+    if (valueA != valueB) return valueA > valueB;
+    if (a.size() != b.size()) return a.size() > b.size();
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i] != b[i]) return pieceRank(a[i]) < pieceRank(b[i]);
+    }
+    return true;
+}
+
+std::string tablebaseSignature(const char* board, bool& swapColors) {
+    int counts[2][6] = {};
+    for (int square = 0; square < 64; square++) {
+        const char piece = board[square];
+        if (piece == '0') continue;
+        counts[std::isupper(piece) ? 0 : 1][pieceRank(piece) % 6]++;
+    }
+    std::string sides[2];
+    for (int side = 0; side < 2; side++) {
+        for (int rank = 0; rank < 6; rank++) {
+            sides[side].append(counts[side][rank], PIECE_ORDER[rank]);
+        }
+    }
+    swapColors = !strongerSide(sides[0], sides[1]);
+    return swapColors ? sides[1] + "v" + sides[0] : sides[0] + "v" + sides[1];
+}
+
+std::string tablebaseSignature(const std::string& first, const std::string& second) {
+    return strongerSide(first, second) ? first + "v" + second : second + "v" + first;
+}
+
+bool TBLayout::fromSignature(const std::string& signature, TBLayout& layout) {
+    const size_t split = signature.find('v');
+    if (split == std::string::npos) return false;
+    const std::string white = signature.substr(0, split);
+    const std::string black = signature.substr(split + 1);
+    if (white.empty() || black.empty() || white[0] != 'K' || black[0] != 'K') return false;
+    if (white.size() + black.size() > TB_MAX_PIECES || !strongerSide(white, black)) return false;
+
+    layout           = TBLayout();
+    layout.signature = signature;
+    for (const std::string* side : {&white, &black}) {
+        for (size_t i = 0; i < side->size(); i++) {
+            const char piece = (*side)[i];
+            // one king per side, first, and the rest in PIECE_ORDER
+            if (!std::strchr(PIECE_ORDER, piece) || (i > 0 && (piece == 'K' || pieceRank(piece) < pieceRank((*side)[i - 1])))) {
+                return false;
+            }
+            layout.pieces[layout.count++] = side == &white ? piece : static_cast<char>(std::tolower(piece));
+            layout.pawns |= piece == 'P';
+        }
+    }
+
+    layout.blackKing = static_cast<int>(white.size());
+    layout.positions = layout.pawns ? KING_PAIRS_PAWNS : KING_PAIRS_PAWNLESS;
+    for (int i = 2; i < layout.count; i++) {
+        layout.positions *= 64;
+    }
+    return true;
+}
+
+// identical pieces are taken in ascending square order, so swapping them doesn't give a second index
+static uint64_t rawIndex(const TBLayout& layout, const int* mapped) {
+    assert(layout.count <= TB_MAX_PIECES);
+    int squares[TB_MAX_PIECES];
+    std::copy(mapped, mapped + layout.count, squares);
+    for (int i = 1, run = 1; i < layout.count; i = run) {
+        while (run < layout.count && layout.pieces[run] == layout.pieces[i]) run++;
+        assert(run <= TB_MAX_PIECES);
+        // insertion sort over the run, at most TB_MAX_PIECES - 1 squares
+        for (int j = i + 1; j < run; j++) {
+            const int square = squares[j];
+            int       k      = j;
+            for (; k > i && squares[k - 1] > square; k--) {
+                squares[k] = squares[k - 1];
+            }
+            squares[k] = square;
+        }
+    }
+
+    const int pair = KING_PAIRS.index[layout.pawns][squares[0]][squares[layout.blackKing]];
+    if (pair < 0) {
+        return TB_NO_INDEX;
+    }
+    uint64_t index = static_cast<uint64_t>(pair);
+    for (int i = 1; i < layout.count; i++) {
+        if (i != layout.blackKing) {
+            index = index * 64 + squares[i];
+        }
+    }
+    return index;
+}
+
+static int transpose(const int square) {
+    return ((square & 7) << 3) | (square >> 3);
+}
+
+uint64_t TBLayout::encode(const int* squares) const {
+    int mapped[TB_MAX_PIECES];
+    std::copy(squares, squares + count, mapped);
+
+    // mirror so the white king lands in the reduced region, every piece moving with it
+    if ((mapped[0] & 7) > 3) {
+        for (int i = 0; i < count; i++) mapped[i] ^= 7;
+    }
+    if (!pawns) {
+        if ((mapped[0] >> 3) > 3) {
+            for (int i = 0; i < count; i++) mapped[i] ^= 56;
+        }
+        if ((mapped[0] >> 3) > (mapped[0] & 7)) {
+            for (int i = 0; i < count; i++) mapped[i] = transpose(mapped[i]);
+        }
+    }
+
+    uint64_t index = rawIndex(*this, mapped);
+    // a king on the a1-h8 diagonal stays put under the reflection in it, the smaller index stands for both;
+    // with the black king off the diagonal only one of the two is indexed at all
+    if (!pawns && (mapped[0] >> 3) == (mapped[0] & 7)) {
+        for (int i = 0; i < count; i++) mapped[i] = transpose(mapped[i]);
+        index = std::min(index, rawIndex(*this, mapped));
+    }
+    return index;
+}
+
+void TBLayout::decode(uint64_t index, int* squares) const {
+    for (int i = count - 1; i > 0; i--) {
+        if (i != blackKing) {
+            squares[i] = static_cast<int>(index & 63);
+            index >>= 6;
+        }
+    }
+    squares[0]         = KING_PAIRS.squares[pawns][index][0];
+    squares[blackKing] = KING_PAIRS.squares[pawns][index][1];
+}
+
+bool TBLayout::squaresOf(const char* board, const bool swapColors, int* squares) const {
+    // one pass over the board, identical pieces taking their slots in square order
+    bool placed[TB_MAX_PIECES] = {};
+    int  found                 = 0;
+    for (int square = 0; square < 64 && found < count; square++) {
+        char piece = board[square];
+        if (piece == '0') continue;
+        if (swapColors) {
+            piece = std::isupper(piece) ? static_cast<char>(std::tolower(piece)) : static_cast<char>(std::toupper(piece));
+        }
+        for (int i = 0; i < count; i++) {
+            if (placed[i] || pieces[i] != piece) continue;
+            // the move generator doesn't promote, and a pawn left on the last rank isn't in any table
+            if ((piece == 'P' || piece == 'p') && (square < 8 || square >= 56)) {
+                return false;
+            }
+            placed[i]  = true;
+            squares[i] = swapColors ? square ^ 56 : square;
+            found++;
+            break;
+        }
+    }
+    return found == count;
+}
+
+int Tablebases::load(const std::string& directory) {
+    std::error_code error;
+    if (!std::filesystem::is_directory(directory, error)) {
+        return 0;
+    }
+
+    int loaded = 0;
+    for (const auto& file : std::filesystem::directory_iterator(directory, error)) {
+        if (file.path().extension() != TB_EXTENSION) continue;
+
+        auto table = std::make_unique<Table>();
+        if (!TBLayout::fromSignature(file.path().stem().string(), table->layout) || !table->file.open(file.path().string())) {
+            std::cerr << "tablebase: skipping " << file.path().string() << std::endl;
+            continue;
+        }
+
+        const TBLayout& layout   = table->layout;
+        const uint64_t  wdlBytes = (2 * layout.positions + 3) / 4;
+        TBHeader        header;
+        bool            valid = table->file.size() >= sizeof(TBHeader);
+        if (valid) {
+            std::memcpy(&header, table->file.data(), sizeof(header));
+            valid = std::memcmp(header.magic, TB_MAGIC, sizeof(TB_MAGIC)) == 0 && header.pieces == layout.count &&
+                    header.positions == layout.positions &&
+                    table->file.size() == sizeof(TBHeader) + wdlBytes + (header.dtm ? 2 * layout.positions : 0);
+        }
+        if (!valid) {
+            std::cerr << "tablebase: " << file.path().string() << " doesn't match its signature" << std::endl;
+            continue;
+        }
+
+        table->wdl = table->file.data() + sizeof(TBHeader);
+        table->dtm = header.dtm ? table->wdl + wdlBytes : nullptr;
+        _maxPieces = std::max(_maxPieces, layout.count);
+        _tables.push_back(std::move(table));
+        loaded++;
+    }
+    index();
+    return loaded;
+}
+
+static size_t slotOf(const uint64_t key, const size_t mask) {
+    return static_cast<size_t>((key * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+}
+
+void Tablebases::index() {
+    size_t size = 4;
+    while (size < 4 * _tables.size()) {
+        size *= 2;
+    }
+    _slots.assign(size, Slot{0, nullptr, false});
+
+    for (const auto& table : _tables) {
+        const std::string& signature = table->layout.signature;
+        const size_t       split     = signature.find('v');
+        const std::string  swapped   = signature.substr(split + 1) + "v" + signature.substr(0, split);
+        // a table with the same material on both sides is only entered once, unswapped
+        for (const bool swapColors : {false, true}) {
+            const uint64_t key = materialKeyOf(swapColors ? swapped : signature);
+            if (find(key)) {
+                continue;
+            }
+            size_t slot = slotOf(key, _slots.size() - 1);
+            while (_slots[slot].key != 0) {
+                slot = (slot + 1) & (_slots.size() - 1);
+            }
+            _slots[slot] = Slot{key, table.get(), swapColors};
+        }
+    }
+}
+
+const Tablebases::Slot* Tablebases::find(const uint64_t materialKey) const {
+    if (_slots.empty()) {
+        return nullptr;
+    }
+    for (size_t slot = slotOf(materialKey, _slots.size() - 1); _slots[slot].key != 0;
+         slot = (slot + 1) & (_slots.size() - 1)) {
+        if (_slots[slot].key == materialKey) {
+            return &_slots[slot];
+        }
+    }
+    return nullptr;
+}
+
+bool Tablebases::probeWdl(const GameState& state, TBResult& result, int* dtm) const {
+    if (state.pieceCount > _maxPieces) {
+        return false;
+    }
+
+    const Slot* found = find(state.materialKey);
+    if (!found) {
+        return false;
+    }
+    const Table&    table      = *found->table;
+    const TBLayout& layout     = table.layout;
+    const bool      swapColors = found->swapColors;
+
+    int squares[TB_MAX_PIECES];
+    if (!layout.squaresOf(state.state, swapColors, squares)) {
+        return false;
+    }
+
+    const uint64_t placement = layout.encode(squares);
+    if (placement == TB_NO_INDEX) {
+        return false;
+    }
+    const bool     whiteToMove = (state.color == WHITE) != swapColors;
+    const uint64_t index       = (whiteToMove ? 0 : layout.positions) + placement;
+    const TBResult value       = static_cast<TBResult>((table.wdl[index >> 2] >> ((index & 3) * 2)) & 3);
+    if (value == TBInvalid) {
+        return false;
+    }
+
+    result = value;
+    if (dtm) {
+        *dtm = table.dtm ? table.dtm[index] : value == TBWin ? 1 : 0;
+    }
+    return true;
+}
+
+bool Tablebases::filterRootMoves(GameState& state, std::vector<BitMove>& moves) const {
+    if (state.pieceCount > _maxPieces || moves.empty()) {
+        return false;
+    }
+
+    // wins rank above draws above losses, faster wins and slower losses above the rest
+    std::vector<int> ranks;
+    for (const BitMove& move : moves) {
+        TBResult result;
+        int      dtm = 0;
+        state.pushMove(move);
+        const bool known = probeWdl(state, result, &dtm);
+        state.popState();
+        if (!known) {
+            return false;
+        }
+        // the child's result is the opponent's
+        ranks.push_back(result == TBLoss ? 1000 - dtm : result == TBWin ? -1000 + dtm : 0);
+    }
+
+    const int            best = *std::max_element(ranks.begin(), ranks.end());
+    std::vector<BitMove> kept;
+    for (size_t i = 0; i < moves.size(); i++) {
+        if (ranks[i] == best) {
+            kept.push_back(moves[i]);
+        }
+    }
+    moves.swap(kept);
+    return true;
+}
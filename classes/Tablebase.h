@@ -0,0 +1,116 @@
+#pragma once
+
+#include "GameState.h"
+#include "MappedFile.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Only legal king placements are indexed, but every other piece keeps 6 bits of its square, duplicates and
+// illegal placements included. Up to 4 pieces a slot is 2 bits of WDL and a byte of DTM, 18 MB for a pawn table
+// (2 x 1806 x 64^2 slots); 5 piece tables keep only the WDL, 60 MB pawnless and 237 MB with pawns
+// (2 x 1806 x 64^3 slots). The generator holds 3 bytes a slot, 2.8 GB for the largest.
+constexpr int         TB_MAX_PIECES     = 5;
+constexpr int         TB_MAX_DTM_PIECES = 4;
+constexpr int         TB_MAX_DTM        = 254;
+constexpr char        TB_MAGIC[4]       = {'C', 'T', 'B', '2'};
+constexpr const char* TB_EXTENSION      = ".ctb";
+// TBLayout::encode of a placement with the kings next to each other
+constexpr uint64_t    TB_NO_INDEX       = ~0ULL;
+
+// game theoretic value from the side to move's point of view
+enum TBResult : uint8_t {
+    TBDraw    = 0,
+    TBWin     = 1,
+    TBLoss    = 2,
+    TBInvalid = 3, // index that isn't a legal position
+};
+
+//
+// One file per material signature, named after it ("KRPvKR.ctb"), the stronger side as white.
+// Little endian:
+//   TBHeader
+//   WDL: 2 bits per position, four to a byte, all white to move positions then all black to move
+//   DTM: 1 byte per position in the same order, plies to mate for wins and losses, 0 for draws;
+//        longer distances are stored as the longest one of the same parity up to TB_MAX_DTM.
+//        Only tables of up to TB_MAX_DTM_PIECES pieces have it.
+//
+struct TBHeader {
+    char     magic[4]; // TB_MAGIC
+    uint8_t  pieces;
+    uint8_t  pawns;
+    uint8_t  dtm;       // 1 if the DTM section follows the WDL one
+    uint8_t  reserved;
+    uint64_t positions; // per side to move
+};
+
+//
+// Position indexing shared by the prober and the generator. Pieces are indexed in a fixed order, white king
+// first. Symmetry puts the white king on a1-d1-d4 for pawnless tables or on files a-d when there are pawns, and
+// the two kings together take one of the placements left with the black king not next to the white one: 462
+// pawnless, where a white king on the a1-h8 diagonal also keeps the black king on or below it, or 1806 with
+// pawns. Every other piece takes 6 bits of its raw square. Each position has exactly one index, so an index
+// that encode(decode(index)) doesn't give back is a duplicate and is stored as TBInvalid.
+//
+struct TBLayout {
+    std::string signature;
+    char        pieces[TB_MAX_PIECES]; // board characters in index order, e.g. 'K', 'Q', 'k'
+    int         count     = 0;
+    int         blackKing = 0; // index of the black king in pieces
+    bool        pawns     = false;
+    uint64_t    positions = 0;
+
+    // "KQvK" -> layout, false for malformed or oversized signatures
+    static bool fromSignature(const std::string& signature, TBLayout& layout);
+
+    // squares in index order; the symmetry is applied to a copy. TB_NO_INDEX if the kings touch.
+    uint64_t encode(const int* squares) const;
+    void     decode(uint64_t index, int* squares) const;
+    // the squares of the layout's pieces on the board, colors swapped and ranks mirrored if asked;
+    // false if a piece is missing or a pawn stands on the first or last rank
+    bool squaresOf(const char* board, bool swapColors, int* squares) const;
+};
+
+// Canonical signature of the board's material and whether colors must be swapped to match it.
+std::string tablebaseSignature(const char* board, bool& swapColors);
+// signature for two sides' pieces, kings first ("KR", "KQ" -> "KQvKR")
+std::string tablebaseSignature(const std::string& first, const std::string& second);
+
+class Tablebases {
+public:
+    // maps every table file in the directory, returns how many were loaded
+    int load(const std::string& directory);
+    int maxPieces() const { return _maxPieces; }
+
+    // false when no table covers the position; dtm, if given, gets the plies to mate, or for a table without
+    // DTM the shortest distance of the right parity, 1 for a win and 0 otherwise
+    bool probeWdl(const GameState& state, TBResult& result, int* dtm = nullptr) const;
+    // Keeps the root moves that preserve the best result; of those, the fastest win or the longest loss where
+    // the tables have DTM.
+    // Returns false, leaving the list alone, unless every move's result is known.
+    bool filterRootMoves(GameState& state, std::vector<BitMove>& moves) const;
+
+private:
+    struct Table {
+        TBLayout             layout;
+        MappedFile           file;
+        const unsigned char* wdl;
+        const unsigned char* dtm; // nullptr for a WDL only table
+    };
+
+    // a table as seen from one color: the material key of the board it covers and whether colors are swapped
+    struct Slot {
+        uint64_t     key; // GameState::materialKey, 0 for an empty slot
+        const Table* table;
+        bool         swapColors;
+    };
+
+    void        index();
+    const Slot* find(uint64_t materialKey) const;
+
+    std::vector<std::unique_ptr<Table>> _tables;
+    // open addressed by material key, a power of two at least twice the entries, so a probe is one or two reads
+    std::vector<Slot>                   _slots;
+    int                                 _maxPieces = 0;
+};
@@ -0,0 +1,138 @@
+#include "Trace.h"
+
+#ifdef CHESS_TRACE
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// per thread, 24 bytes each
+constexpr uint64_t TRACE_BUFFER_EVENTS = 1 << 15;
+
+struct TraceEvent {
+    const char* name;
+    uint64_t    start;
+    uint64_t    end;
+};
+
+// Written only by its thread. head counts every event ever written, so the ring holds the last
+// TRACE_BUFFER_EVENTS before it; a dump reads behind it and drops what was overwritten meanwhile.
+struct TraceBuffer {
+    std::atomic<uint64_t>         head{0};
+    std::atomic<const char*>      name{nullptr};
+    bool                          inUse = true;
+    std::unique_ptr<TraceEvent[]> events{new TraceEvent[TRACE_BUFFER_EVENTS]()};
+};
+
+// buffers outlive their threads, so a dump still shows a search that has finished, and are handed on to the
+// next thread that starts; each one is a lane of the trace
+static std::mutex                                _buffersMutex;
+static std::vector<std::unique_ptr<TraceBuffer>> _buffers;
+
+// releases the thread's buffer when the thread ends
+struct TraceThread {
+    TraceBuffer* buffer = nullptr;
+    ~TraceThread() {
+        if (buffer) {
+            std::lock_guard<std::mutex> lock(_buffersMutex);
+            buffer->inUse = false;
+        }
+    }
+};
+static thread_local TraceThread _thread;
+
+static TraceBuffer& threadBuffer() {
+    if (!_thread.buffer) {
+        std::lock_guard<std::mutex> lock(_buffersMutex);
+        for (auto& buffer : _buffers) {
+            if (!buffer->inUse) {
+                buffer->inUse  = true;
+                _thread.buffer = buffer.get();
+                break;
+            }
+        }
+        if (!_thread.buffer) {
+            _buffers.push_back(std::make_unique<TraceBuffer>());
+            _thread.buffer = _buffers.back().get();
+        }
+    }
+    return *_thread.buffer;
+}
+
+uint64_t traceNow() {
+    static const auto epoch = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void traceRecord(const char* name, const uint64_t start, const uint64_t end) {
+    TraceBuffer&   buffer = threadBuffer();
+    const uint64_t head   = buffer.head.load(std::memory_order_relaxed);
+    buffer.events[head & (TRACE_BUFFER_EVENTS - 1)] = TraceEvent{name, start, end};
+    buffer.head.store(head + 1, std::memory_order_release);
+}
+
+void traceThreadName(const char* name) {
+    threadBuffer().name.store(name, std::memory_order_relaxed);
+}
+
+bool traceDump(const std::string& path) {
+    std::ofstream out(path);
+    if (!out) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(_buffersMutex);
+    // microseconds to the nanosecond
+    out << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+    bool first = true;
+    for (size_t lane = 0; lane < _buffers.size(); lane++) {
+        TraceBuffer& buffer = *_buffers[lane];
+        const char*  name   = buffer.name.load(std::memory_order_relaxed);
+        if (name) {
+            out << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << lane
+                << ",\"args\":{\"name\":\"" << name << "\"}}";
+            first = false;
+        }
+
+        const uint64_t          head  = buffer.head.load(std::memory_order_acquire);
+        const uint64_t          begin = head > TRACE_BUFFER_EVENTS ? head - TRACE_BUFFER_EVENTS : 0;
+        std::vector<TraceEvent> events(buffer.events.get() + (begin & (TRACE_BUFFER_EVENTS - 1)),
+                                       buffer.events.get() + TRACE_BUFFER_EVENTS);
+        events.insert(events.end(), buffer.events.get(), buffer.events.get() + (begin & (TRACE_BUFFER_EVENTS - 1)));
+        events.resize(head - begin);
+        // the thread kept writing while they were copied, the oldest may have been overwritten or be being written
+        const uint64_t now     = buffer.head.load(std::memory_order_acquire) + 1;
+        const uint64_t overrun = now > begin + TRACE_BUFFER_EVENTS ? now - begin - TRACE_BUFFER_EVENTS : 0;
+
+        for (uint64_t i = std::min<uint64_t>(overrun, events.size()); i < events.size(); i++) {
+            const TraceEvent& event = events[i];
+            out << (first ? "" : ",") << "\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << lane
+                << ",\"ts\":" << event.start / 1000.0 << ",\"dur\":" << (event.end - event.start) / 1000.0 << "}";
+            first = false;
+        }
+    }
+    out << "\n]}\n";
+    return static_cast<bool>(out);
+}
+
+#else
+
+uint64_t traceNow() {
+    return 0;
+}
+
+void traceRecord(const char*, uint64_t, uint64_t) {
+}
+
+void traceThreadName(const char*) {
+}
+
+bool traceDump(const std::string&) {
+    return false;
+}
+
+#endif
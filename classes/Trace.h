@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Scoped timers for a Chrome trace (chrome://tracing or ui.perfetto.dev) of the UI and the search on one
+// timeline. They compile to nothing unless the build is configured with CHESS_TRACE on. Then a scope costs two
+// clock reads and one write into its thread's ring buffer, which keeps the last TRACE_BUFFER_EVENTS scopes.
+//
+//   TRACE_SCOPE("drawFrame");       // until the end of the enclosing block
+//   TRACE_THREAD_NAME("search");    // the lane's name in the viewer
+//
+// Names must be string literals, only the pointer is kept.
+#ifdef CHESS_TRACE
+#define TRACE_CONCAT_(a, b)     a##b
+#define TRACE_CONCAT(a, b)      TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name)       TraceScope TRACE_CONCAT(_traceScope, __LINE__)(name)
+#define TRACE_THREAD_NAME(name) traceThreadName(name)
+#else
+#define TRACE_SCOPE(name)       do {} while (0)
+#define TRACE_THREAD_NAME(name) do {} while (0)
+#endif
+
+// nanoseconds since the first call
+uint64_t traceNow();
+void     traceRecord(const char* name, uint64_t start, uint64_t end);
+void     traceThreadName(const char* name);
+// writes every buffered scope of every thread as trace_event JSON, false if it can't or tracing is compiled out
+bool     traceDump(const std::string& path);
+
+class TraceScope {
+public:
+    explicit TraceScope(const char* name) : _name(name), _start(traceNow()) {}
+    ~TraceScope() { traceRecord(_name, _start, traceNow()); }
+
+private:
+    const char* _name;
+    uint64_t    _start;
+};
@@ -0,0 +1,108 @@
+#include "TranspositionTable.h"
+#include "Search.h"
+#include <algorithm>
+#include <cstring>
+
+// entries sampled by hashfull
+constexpr size_t HASHFULL_SAMPLE = 1000;
+// entries a position may be stored in, next to each other so one probe touches one cache line
+constexpr size_t BUCKET_ENTRIES = 2;
+
+// the fields after the key folded into one word
+static uint64_t fold(const TTEntry& entry) {
+    uint32_t move;
+    std::memcpy(&move, &entry.move, sizeof(move));
+    const uint64_t rest = static_cast<uint16_t>(entry.depth) | (static_cast<uint64_t>(entry.bound) << 16) |
+        (static_cast<uint64_t>(entry.generation) << 24);
+    return ((static_cast<uint64_t>(move) << 32) | static_cast<uint32_t>(entry.score)) ^ (rest * 0x9E3779B97F4A7C15ULL);
+}
+
+void TranspositionTable::resize(const size_t megabytes) {
+    size_t count = BUCKET_ENTRIES;
+    while (count * 2 * sizeof(TTEntry) <= megabytes * 1024 * 1024) {
+        count *= 2;
+    }
+
+    _entries.assign(count, TTEntry{});
+    // the first entry of a bucket
+    _mask = (count - 1) & ~(BUCKET_ENTRIES - 1);
+}
+
+void TranspositionTable::clear() {
+    std::fill(_entries.begin(), _entries.end(), TTEntry{});
+    _generation = 0;
+}
+
+bool TranspositionTable::probe(const uint64_t key, TTEntry& entry) const {
+    const TTEntry* bucket = &_entries[key & _mask];
+    for (size_t i = 0; i < BUCKET_ENTRIES; i++) {
+        entry = bucket[i];
+        if ((entry.key ^ fold(entry)) == key && entry.bound != TTNone) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void TranspositionTable::store(const uint64_t key, const int score, const BitMove& move, const int depth,
+                               const TTBound bound) {
+    // The position's own entry if the bucket has one. Otherwise the one worth least: an entry from an older
+    // search before any from this one, then the shallowest, so deep results and exact tablebase scores stored at
+    // MAX_DEPTH - 1 survive a stream of shallow stores.
+    TTEntry* bucket = &_entries[key & _mask];
+    TTEntry* slot   = nullptr;
+    TTEntry  current;
+    bool     same   = false;
+    int      lowest = 0;
+    for (size_t i = 0; i < BUCKET_ENTRIES; i++) {
+        const TTEntry entry = bucket[i];
+        if ((entry.key ^ fold(entry)) == key) {
+            slot    = &bucket[i];
+            current = entry;
+            same    = true;
+            break;
+        }
+        const int worth = entry.bound == TTNone ? -1 : entry.depth + (entry.generation == _generation ? MAX_DEPTH : 0);
+        if (!slot || worth < lowest) {
+            slot    = &bucket[i];
+            current = entry;
+            lowest  = worth;
+        }
+    }
+
+    // keep a deeper result for the same search unless this one is exact
+    if (same && current.generation == _generation && depth < current.depth && bound != TTExact) {
+        return;
+    }
+
+    TTEntry entry;
+    entry.score = score;
+    // don't lose the best move of this position when storing a result that has none
+    entry.move       = (move.piece == NoPiece && same) ? current.move : move;
+    entry.depth      = static_cast<int16_t>(depth);
+    entry.bound      = bound;
+    entry.generation = _generation;
+    entry.key        = key ^ fold(entry);
+    *slot            = entry;
+}
+
+int TranspositionTable::hashfull() const {
+    const size_t sample = std::min(HASHFULL_SAMPLE, _entries.size());
+    size_t       used   = 0;
+    for (size_t i = 0; i < sample; i++) {
+        used += _entries[i].bound != TTNone && _entries[i].generation == _generation;
+    }
+    return static_cast<int>(used * 1000 / sample);
+}
+
+int TranspositionTable::scoreToTT(const int score, const int ply) {
+    if (score >= SCORE_TB_BOUND) return score + ply;
+    if (score <= -SCORE_TB_BOUND) return score - ply;
+    return score;
+}
+
+int TranspositionTable::scoreFromTT(const int score, const int ply) {
+    if (score >= SCORE_TB_BOUND) return score - ply;
+    if (score <= -SCORE_TB_BOUND) return score + ply;
+    return score;
+}
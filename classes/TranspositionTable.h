@@ -0,0 +1,49 @@
+#pragma once
+
+#include "GameState.h"
+#include <cstdint>
+#include <vector>
+
+enum TTBound : uint8_t {
+    TTNone  = 0,
+    TTUpper = 1, // search failed low, score is at most this
+    TTLower = 2, // search failed high, score is at least this
+    TTExact = TTUpper | TTLower,
+};
+
+struct TTEntry {
+    uint64_t key; // position key xor the folded fields below, so an entry torn by two threads storing at once won't verify
+    int32_t  score;
+    BitMove  move;
+    int16_t  depth;
+    uint8_t  bound;
+    uint8_t  generation;
+};
+
+class TranspositionTable {
+public:
+    TranspositionTable() { resize(16); }
+
+    // table size in megabytes, rounded down to a power of two number of entries
+    void resize(size_t megabytes);
+    void clear();
+    // called once per search so entries from older searches get replaced first
+    void newSearch() { ++_generation; }
+
+    // Shared by every search thread without locks; an entry half overwritten by another thread fails its
+    // key check and reads as a miss.
+    bool probe(uint64_t key, TTEntry& entry) const;
+    void store(uint64_t key, int score, const BitMove& move, int depth, TTBound bound);
+
+    // permille of a sample of entries written by the current search, for UCI's hashfull
+    int hashfull() const;
+
+    // mate and tablebase scores are stored relative to the node, not the root, so they stay valid at other plies
+    static int scoreToTT(int score, int ply);
+    static int scoreFromTT(int score, int ply);
+
+private:
+    std::vector<TTEntry> _entries;
+    uint64_t             _mask       = 0;
+    uint8_t              _generation = 0;
+};
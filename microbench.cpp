@@ -0,0 +1,338 @@
+//
+// chess-microbench: nanoseconds per operation for the hot paths of the engine and, in demo-microbench, of the
+// framework around it.
+//
+//   chess-microbench [--filter text] [--reps n] [--json file|-]
+//
+// Every benchmark is calibrated to take at least MIN_REP_MS per repetition, run WARMUP_REPS times unmeasured and
+// then --reps times. The table shows the mean, standard deviation and fastest repetition in ns/op; --json writes
+// the same as one document for scripts comparing two builds. A change moved a path when its mean moved by more
+// than a few standard deviations.
+//
+// demo-microbench is built from the same file with MICROBENCH_FRAMEWORK and the demo's sources. It opens a hidden
+// window for a graphics device so sprites can upload their textures, and looks for them under resources/.
+//
+#include "classes/GameState.h"
+#include "classes/Evaluate.h"
+
+#ifdef MICROBENCH_FRAMEWORK
+#include "classes/Chess.h"
+#include "classes/Grid.h"
+#include "classes/Sprite.h"
+#include "classes/stb_image.h"
+#ifdef _WIN32
+#include <d3d11.h>
+#else
+#include <GLFW/glfw3.h>
+#endif
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+constexpr int     WARMUP_REPS  = 2;
+constexpr int     DEFAULT_REPS = 10;
+constexpr int64_t MIN_REP_MS   = 20;
+
+// one benchmark: run(iterations) does the operation that many times and returns something that depends on
+// every result, so the compiler can't drop the work
+struct MicroBenchmark {
+    std::string                       name;
+    std::function<uint64_t(uint64_t)> run;
+};
+
+struct MicroResult {
+    std::string name;
+    uint64_t    iterations; // per repetition
+    int         reps;
+    double      meanNs;
+    double      stddevNs;
+    double      minNs;
+    double      maxNs;
+};
+
+// results are folded in here so no benchmark's work is dead code
+static volatile uint64_t _sink = 0;
+
+static double nanosecondsPerOp(const MicroBenchmark& benchmark, const uint64_t iterations) {
+    const auto start = std::chrono::steady_clock::now();
+    _sink            = _sink + benchmark.run(iterations);
+    const auto end   = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+}
+
+static MicroResult measure(const MicroBenchmark& benchmark, const int reps) {
+    // double the iterations until one repetition is long enough for the clock to be negligible
+    uint64_t iterations = 1;
+    while (nanosecondsPerOp(benchmark, iterations) * iterations < MIN_REP_MS * 1e6) {
+        iterations *= 2;
+    }
+    for (int rep = 0; rep < WARMUP_REPS; rep++) {
+        nanosecondsPerOp(benchmark, iterations);
+    }
+
+    std::vector<double> samples;
+    for (int rep = 0; rep < reps; rep++) {
+        samples.push_back(nanosecondsPerOp(benchmark, iterations));
+    }
+    double mean = 0;
+    for (const double sample : samples) {
+        mean += sample;
+    }
+    mean /= samples.size();
+    double variance = 0;
+    for (const double sample : samples) {
+        variance += (sample - mean) * (sample - mean);
+    }
+    variance /= std::max<size_t>(1, samples.size() - 1);
+
+    return MicroResult{benchmark.name, iterations, reps, mean, std::sqrt(variance),
+                       *std::min_element(samples.begin(), samples.end()),
+                       *std::max_element(samples.begin(), samples.end())};
+}
+
+// position classes the move generator and the evaluation are measured on
+static const std::pair<const char*, const char*> POSITIONS[] = {
+    {"opening", "r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w - - 4 4"},
+    {"middlegame", "r1bq1r1k/b1p1npp1/p2p3p/1p6/3PP3/1B2NN2/PP3PPP/R2Q1RK1 w - - 1 16"},
+    {"endgame", "8/pp2r1k1/2p1p3/3pP2p/1P1P1P1P/P5KR/8/8 w - - 0 1"},
+    {"check", "rnbqk1nr/pppp1ppp/8/4p3/1b1P4/8/PPP1PPPP/RNBQKBNR w - - 1 3"},
+};
+
+static void addEngineBenchmarks(std::vector<MicroBenchmark>& benchmarks) {
+    // random occupancies seen from random squares, the same every run
+    struct Lookup {
+        int      square;
+        uint64_t occupancy;
+    };
+    static std::vector<Lookup> lookups;
+    std::mt19937_64 random(12345);
+    for (int i = 0; i < 4096; i++) {
+        lookups.push_back({static_cast<int>(random() & 63), random() & random()});
+    }
+    for (const ChessPiece piece : {Bishop, Rook, Queen}) {
+        const char* names[] = {"", "", "", "bishop", "rook", "queen"};
+        benchmarks.push_back({std::string("magic/") + names[piece], [piece](const uint64_t iterations) {
+            uint64_t sum = 0;
+            for (uint64_t i = 0; i < iterations; i++) {
+                const Lookup& lookup = lookups[i & 4095];
+                sum += GameState::pieceAttacks(piece, lookup.square, lookup.occupancy);
+            }
+            return sum;
+        }});
+    }
+
+    for (const auto& [kind, fen] : POSITIONS) {
+        const std::string name     = kind;
+        const std::string position = fen;
+
+        benchmarks.push_back({"generateAllMoves/" + name, [position](const uint64_t iterations) {
+            GameState state;
+            state.initFen(position);
+            uint64_t sum = 0;
+            for (uint64_t i = 0; i < iterations; i++) {
+                // the maps are kept per node, so each operation rebuilds them as the first use at a new node would
+                state.invalidateAttackMaps();
+                sum += state.generateAllMoves().size();
+            }
+            return sum;
+        }});
+
+        benchmarks.push_back({"filterOutIllegalMoves/" + name, [position](const uint64_t iterations) {
+            GameState state;
+            state.initFen(position);
+            std::vector<BitMove> pseudoLegal;
+            state.generatePseudoLegalMoves(pseudoLegal);
+            std::vector<BitMove> moves;
+            uint64_t             sum = 0;
+            for (uint64_t i = 0; i < iterations; i++) {
+                moves = pseudoLegal;
+                state.filterOutIllegalMoves(moves);
+                sum += moves.size();
+            }
+            return sum;
+        }});
+
+        // one move made and taken back per operation, cycling through the legal moves
+        benchmarks.push_back({"pushMove+popState/" + name, [position](const uint64_t iterations) {
+            GameState state;
+            state.initFen(position);
+            const std::vector<BitMove> moves = state.generateAllMoves();
+            uint64_t                   sum   = 0;
+            for (uint64_t i = 0; i < iterations; i++) {
+                state.pushMove(moves[i % moves.size()]);
+                sum += state.hash;
+                state.popState();
+            }
+            return sum;
+        }});
+
+        benchmarks.push_back({"evaluateBoard/" + name, [position](const uint64_t iterations) {
+            GameState state;
+            state.initFen(position);
+            PawnTable pawnTable;
+            uint64_t  sum = 0;
+            for (uint64_t i = 0; i < iterations; i++) {
+                state.invalidateAttackMaps();
+                sum += evaluateBoard(state, pawnTable);
+            }
+            return sum;
+        }});
+    }
+}
+
+#ifdef MICROBENCH_FRAMEWORK
+#ifdef _WIN32
+// Sprite uploads its textures to this device
+ID3D11Device* g_pd3dDevice = nullptr;
+
+static bool createGraphicsDevice() {
+    return SUCCEEDED(D3D11CreateDevice(nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr, 0, nullptr, 0, D3D11_SDK_VERSION,
+                                       &g_pd3dDevice, nullptr, nullptr));
+}
+#else
+static bool createGraphicsDevice() {
+    if (!glfwInit()) {
+        return false;
+    }
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+#ifdef __APPLE__
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+    GLFWwindow* window = glfwCreateWindow(64, 64, "chess-microbench", nullptr, nullptr);
+    if (!window) {
+        return false;
+    }
+    glfwMakeContextCurrent(window);
+    return true;
+}
+#endif
+
+static void addFrameworkBenchmarks(std::vector<MicroBenchmark>& benchmarks) {
+    // the board as the demo sets it up, textures and all
+    static Chess* chess = nullptr;
+    if (!chess) {
+        chess = new Chess();
+        chess->setUpBoard();
+    }
+    benchmarks.push_back({"Chess::stateString", [](const uint64_t iterations) {
+        uint64_t sum = 0;
+        for (uint64_t i = 0; i < iterations; i++) {
+            sum += chess->stateString().size();
+        }
+        return sum;
+    }});
+
+    // a fresh std::function per call, as every caller passes a lambda
+    benchmarks.push_back({"Grid::forEachSquare", [](const uint64_t iterations) {
+        Grid&    grid = *chess->getGrid();
+        uint64_t sum  = 0;
+        for (uint64_t i = 0; i < iterations; i++) {
+            grid.forEachSquare([&sum](ChessSquare* square, int x, int y) { sum += x + y; });
+        }
+        return sum;
+    }});
+
+    // decoding alone, then decoding and the upload; every upload makes a texture that is never freed, as in the demo
+    benchmarks.push_back({"stbi_load/b_queen.png", [](const uint64_t iterations) {
+        uint64_t sum = 0;
+        for (uint64_t i = 0; i < iterations; i++) {
+            int            width  = 0;
+            int            height = 0;
+            unsigned char* pixels = stbi_load("resources/b_queen.png", &width, &height, nullptr, 4);
+            sum += width * height;
+            stbi_image_free(pixels);
+        }
+        return sum;
+    }});
+    benchmarks.push_back({"Sprite::LoadTextureFromFile/b_queen.png", [](const uint64_t iterations) {
+        uint64_t sum = 0;
+        for (uint64_t i = 0; i < iterations; i++) {
+            Sprite sprite;
+            sum += sprite.LoadTextureFromFile("b_queen.png");
+        }
+        return sum;
+    }});
+}
+#endif
+
+static void writeJson(std::ostream& out, const std::vector<MicroResult>& results) {
+    out << "{\"minRepMs\":" << MIN_REP_MS << ",\"warmupReps\":" << WARMUP_REPS << ",\"benchmarks\":[";
+    for (size_t i = 0; i < results.size(); i++) {
+        const MicroResult& result = results[i];
+        out << (i ? "," : "") << "{\"name\":\"" << result.name << "\",\"iterations\":" << result.iterations
+            << ",\"reps\":" << result.reps << ",\"meanNs\":" << result.meanNs << ",\"stddevNs\":" << result.stddevNs
+            << ",\"minNs\":" << result.minNs << ",\"maxNs\":" << result.maxNs << "}";
+    }
+    out << "]}" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    std::string filter;
+    std::string jsonPath;
+    int         reps = DEFAULT_REPS;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--filter" && i + 1 < argc) filter = argv[++i];
+        else if (arg == "--reps" && i + 1 < argc) reps = std::max(2, std::atoi(argv[++i]));
+        else if (arg == "--json" && i + 1 < argc) jsonPath = argv[++i];
+        else {
+            std::cerr << "usage: " << argv[0] << " [--filter text] [--reps n] [--json file|-]" << std::endl;
+            return 1;
+        }
+    }
+
+    // a first init builds the magic tables and the Zobrist keys
+    GameState first;
+    first.initFen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w - - 0 1");
+    initEvaluation();
+
+    std::vector<MicroBenchmark> benchmarks;
+    addEngineBenchmarks(benchmarks);
+#ifdef MICROBENCH_FRAMEWORK
+    if (createGraphicsDevice()) {
+        addFrameworkBenchmarks(benchmarks);
+    }
+    else {
+        std::cerr << "no graphics device, framework benchmarks skipped" << std::endl;
+    }
+#endif
+
+    // the table goes to stderr when the JSON goes to stdout
+    std::ostream&            table = jsonPath == "-" ? std::cerr : std::cout;
+    std::vector<MicroResult> results;
+    table << std::left << std::setw(44) << "benchmark" << std::right << std::setw(12) << "ns/op" << std::setw(10)
+          << "stddev" << std::setw(12) << "min" << std::setw(14) << "iterations" << std::endl;
+    for (const MicroBenchmark& benchmark : benchmarks) {
+        if (!filter.empty() && benchmark.name.find(filter) == std::string::npos) {
+            continue;
+        }
+        const MicroResult result = measure(benchmark, reps);
+        results.push_back(result);
+        table << std::left << std::setw(44) << result.name << std::right << std::fixed << std::setprecision(2)
+              << std::setw(12) << result.meanNs << std::setw(10) << result.stddevNs << std::setw(12) << result.minNs
+              << std::setw(14) << result.iterations << std::endl;
+    }
+
+    if (jsonPath == "-") {
+        writeJson(std::cout, results);
+    }
+    else if (!jsonPath.empty()) {
+        std::ofstream out(jsonPath);
+        writeJson(out, results);
+    }
+    return 0;
+}
@@ -0,0 +1,610 @@
+//
+// chess-tb: generates endgame tables for Tablebases by retrograde analysis.
+//
+//   chess-tb [--threads n] [-o dir] [--all pieces] [--verify] signature...
+//
+// Positions are indexed as in TBLayout. A first pass over every index marks duplicates and illegal placements,
+// finds the mates, and scores the moves that leave the table (captures and promotions) from the smaller tables
+// already in the output directory. Then, one ply of distance to mate at a time, the predecessors of positions
+// lost at level n are won at n + 1, and the predecessors of positions won at n are lost at n + 1 once the move
+// generator confirms every one of their moves gives the opponent a win. Predecessors are found by moving pieces
+// back with the same attack tables the move generator uses. Both passes are split over worker threads.
+// --verify then reads the written tables back through Tablebases and checks each position against its moves.
+// Tables over TB_MAX_DTM_PIECES pieces are written without their DTM, which is still worked out here to order
+// the passes. A move into such a table counts as the shortest distance of the right parity, which keeps the
+// results right.
+//
+#include "classes/GameState.h"
+#include "classes/Bitbase.h"
+#include "classes/Tablebase.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const char* START_STATE = "RNBQKBNRPPPPPPPP00000000000000000000000000000000pppppppprnbqkbnr";
+constexpr uint64_t CHUNK_POSITIONS = 1 << 16;
+// loss floor of a position that has a move out of the table to a draw or a win, so it can't be lost
+constexpr uint8_t CANNOT_LOSE = 255;
+
+// longer distances are stored as the longest one of the same parity, so the result stays right
+static int capDtm(const int dtm) {
+    return dtm <= TB_MAX_DTM ? dtm : TB_MAX_DTM - (dtm & 1);
+}
+
+struct GeneratorOptions {
+    int                      threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    int                      all     = 0; // generate every table up to this many pieces
+    bool                     verify  = false;
+    std::string              output  = ".";
+    std::vector<std::string> signatures;
+};
+
+static void usage() {
+    std::cerr << "usage: chess-tb [--threads n] [-o dir] [--all pieces] [--verify] signature..." << std::endl
+              << "  signatures name the stronger side first, kings included: KQvK KRPvKR" << std::endl
+              << "  --verify checks every written table against its own moves, and KPvK against the KPK bitbase" << std::endl;
+    std::exit(1);
+}
+
+// calls work(begin, end) on chunks of [0, count) from every thread until the range is used up
+static void parallelFor(const uint64_t count, const int threads, const std::function<void(uint64_t, uint64_t)>& work) {
+    std::atomic<uint64_t>    next{0};
+    std::vector<std::thread> workers;
+    for (int id = 0; id < threads; id++) {
+        workers.emplace_back([&]() {
+            for (uint64_t begin = next.fetch_add(CHUNK_POSITIONS); begin < count; begin = next.fetch_add(CHUNK_POSITIONS)) {
+                work(begin, std::min(count, begin + CHUNK_POSITIONS));
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+static ChessPiece pieceType(const char piece) {
+    switch (piece) {
+    case 'P': case 'p': return Pawn;
+    case 'N': case 'n': return Knight;
+    case 'B': case 'b': return Bishop;
+    case 'R': case 'r': return Rook;
+    case 'Q': case 'q': return Queen;
+    default:            return King;
+    }
+}
+
+// position = side to move * positions + index, false for duplicate indexes and impossible placements
+static bool setUpPosition(const TBLayout& layout, const uint64_t position, GameState& state) {
+    const uint64_t index = position % layout.positions;
+    int            squares[TB_MAX_PIECES];
+    layout.decode(index, squares);
+    if (layout.encode(squares) != index) {
+        return false;
+    }
+
+    char board[64];
+    std::memset(board, '0', sizeof(board));
+    for (int i = 0; i < layout.count; i++) {
+        const char piece = layout.pieces[i];
+        if (board[squares[i]] != '0' || ((piece == 'P' || piece == 'p') && (squares[i] < 8 || squares[i] >= 56))) {
+            return false;
+        }
+        board[squares[i]] = piece;
+    }
+    state.init(board, position < layout.positions ? WHITE : BLACK);
+    return true;
+}
+
+// captures and promotions land in another table; promotions are made to the queen, as pushMove does
+static bool isExit(const GameState& state, BitMove& move) {
+    const char piece = state.state[move.from];
+    if ((piece == 'P' && move.to >= 56) || (piece == 'p' && move.to < 8)) {
+        move.flags |= IsPromotion;
+        return true;
+    }
+    return state.state[move.to] != '0';
+}
+
+class TableGenerator {
+public:
+    TableGenerator(const TBLayout& layout, const Tablebases& smaller, int threads)
+        : _layout(layout)
+        , _smaller(smaller)
+        , _threads(threads)
+        , _count(2 * layout.positions)
+        , _result(_count)
+        , _dtm(_count)
+        , _floor(_count) { }
+
+    // false if a move leaves for a table that hasn't been generated
+    bool generate();
+    bool write(const std::string& path) const;
+
+    uint64_t count(TBResult result) const;
+    int      longestMate() const { return _longest; }
+
+private:
+    // white to move positions first, then black to move
+    uint64_t positionOf(const int side, const uint64_t index) const { return side * _layout.positions + index; }
+    bool     setUp(GameState& state, const uint64_t position) const { return setUpPosition(_layout, position, state); }
+
+    void initRange(uint64_t begin, uint64_t end, std::vector<uint64_t>& mates);
+    void schedule(uint64_t position, int level);
+    void resolveScheduled(int level, std::vector<uint64_t>& resolved);
+    void expand(const std::vector<uint64_t>& frontier, int level, std::vector<uint64_t>& next);
+    bool allMovesLose(GameState& state, uint64_t position) const;
+
+    const TBLayout&   _layout;
+    const Tablebases& _smaller;
+    const int         _threads;
+    const uint64_t    _count;
+
+    std::vector<std::atomic<uint8_t>> _result; // TBResult, TBDraw until proven otherwise
+    // plies to mate once resolved; before that, the level at which a move out of the table decides it, 0 for none
+    std::vector<std::atomic<uint8_t>> _dtm;
+    // the least a loss can take given the moves out of the table, or CANNOT_LOSE
+    std::vector<std::atomic<uint8_t>> _floor;
+
+    std::atomic<int> _lastScheduled{0};
+    std::string      _missing;
+    std::mutex       _missingMutex;
+    int              _longest = 0;
+};
+
+void TableGenerator::initRange(const uint64_t begin, const uint64_t end, std::vector<uint64_t>& mates) {
+    GameState state;
+    for (uint64_t position = begin; position < end; position++) {
+        if (!setUp(state, position)) {
+            _result[position] = TBInvalid;
+            continue;
+        }
+        // the side that just moved can't be left in check
+        state.pushNullMove();
+        const bool illegal = state.inCheck();
+        state.popState();
+        if (illegal) {
+            _result[position] = TBInvalid;
+            continue;
+        }
+
+        std::vector<BitMove> moves = state.generateAllMoves();
+        if (moves.empty()) {
+            if (state.inCheck()) {
+                _result[position] = TBLoss;
+                mates.push_back(position);
+            }
+            continue;
+        }
+
+        int  winLevel = 0;
+        int  floor    = 0;
+        bool inTable  = false;
+        for (BitMove& move : moves) {
+            if (!isExit(state, move)) {
+                inTable = true;
+                continue;
+            }
+            state.pushMove(move);
+            TBResult result = TBDraw;
+            int      dtm    = 0;
+            const bool known = state.pieceCount == 2 || _smaller.probeWdl(state, result, &dtm);
+            if (!known) {
+                bool swapColors;
+                std::lock_guard<std::mutex> lock(_missingMutex);
+                _missing = tablebaseSignature(state.state, swapColors);
+            }
+            state.popState();
+
+            // the other table's result is the opponent's
+            if (result == TBLoss) {
+                winLevel = winLevel ? std::min(winLevel, dtm + 1) : dtm + 1;
+            }
+            else if (result == TBDraw) {
+                floor = CANNOT_LOSE;
+            }
+            else if (floor != CANNOT_LOSE) {
+                floor = std::max(floor, std::min(dtm + 1, TB_MAX_DTM));
+            }
+        }
+
+        if (winLevel) {
+            floor = CANNOT_LOSE;
+        }
+        _floor[position] = static_cast<uint8_t>(floor);
+        // without moves inside the table nothing here will reach the position, so its result is scheduled now
+        const int scheduled = winLevel ? winLevel : (!inTable && floor != CANNOT_LOSE ? floor : 0);
+        if (scheduled) {
+            schedule(position, scheduled);
+        }
+    }
+}
+
+void TableGenerator::schedule(const uint64_t position, const int level) {
+    const int capped = capDtm(level);
+    _dtm[position]   = static_cast<uint8_t>(capped);
+    int last = _lastScheduled.load();
+    while (capped > last && !_lastScheduled.compare_exchange_weak(last, capped)) { }
+}
+
+// positions whose moves out of the table decide them at this level; wins have odd distances, losses even
+void TableGenerator::resolveScheduled(const int level, std::vector<uint64_t>& resolved) {
+    std::mutex mutex;
+    parallelFor(_count, _threads, [&](const uint64_t begin, const uint64_t end) {
+        std::vector<uint64_t> found;
+        for (uint64_t position = begin; position < end; position++) {
+            if (_dtm[position].load(std::memory_order_relaxed) != level) continue;
+            uint8_t unresolved = TBDraw;
+            if (_result[position].compare_exchange_strong(unresolved, level % 2 ? TBWin : TBLoss)) {
+                found.push_back(position);
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        resolved.insert(resolved.end(), found.begin(), found.end());
+    });
+}
+
+bool TableGenerator::allMovesLose(GameState& state, const uint64_t position) const {
+    if (_floor[position] == CANNOT_LOSE || !setUp(state, position)) {
+        return false;
+    }
+    std::vector<BitMove> moves = state.generateAllMoves();
+    for (BitMove& move : moves) {
+        if (isExit(state, move)) continue;
+        state.pushMove(move);
+        int        squares[TB_MAX_PIECES];
+        const bool found = _layout.squaresOf(state.state, false, squares);
+        const int  side  = state.color == WHITE ? 0 : 1;
+        state.popState();
+        if (!found || _result[positionOf(side, _layout.encode(squares))] != TBWin) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void TableGenerator::expand(const std::vector<uint64_t>& frontier, const int level, std::vector<uint64_t>& next) {
+    const TBResult gained = level % 2 ? TBLoss : TBWin;
+    std::mutex     mutex;
+    parallelFor(frontier.size(), _threads, [&](const uint64_t begin, const uint64_t end) {
+        GameState             state;
+        std::vector<uint64_t> found;
+        for (uint64_t i = begin; i < end; i++) {
+            const uint64_t position = frontier[i];
+            const int      side     = position < _layout.positions ? 0 : 1;
+            const int      mover    = 1 - side;
+            int            squares[TB_MAX_PIECES];
+            _layout.decode(position % _layout.positions, squares);
+            uint64_t occupancy = 0;
+            for (int j = 0; j < _layout.count; j++) {
+                occupancy |= 1ULL << squares[j];
+            }
+
+            // take back every quiet move of the side that just moved
+            for (int j = 0; j < _layout.count; j++) {
+                const char piece = _layout.pieces[j];
+                if ((std::isupper(piece) != 0) != (mover == 0)) continue;
+
+                const int  square = squares[j];
+                uint64_t   origins;
+                if (piece == 'P') {
+                    const uint64_t single = square >= 16 ? (1ULL << (square - 8)) & ~occupancy : 0;
+                    const uint64_t twice  = (square >> 3) == 3 && single ? (1ULL << (square - 16)) & ~occupancy : 0;
+                    origins = single | twice;
+                }
+                else if (piece == 'p') {
+                    const uint64_t single = square < 48 ? (1ULL << (square + 8)) & ~occupancy : 0;
+                    const uint64_t twice  = (square >> 3) == 4 && single ? (1ULL << (square + 16)) & ~occupancy : 0;
+                    origins = single | twice;
+                }
+                else {
+                    origins = GameState::pieceAttacks(pieceType(piece), square, occupancy) & ~occupancy;
+                }
+
+                for (; origins; origins &= origins - 1) {
+                    int previous[TB_MAX_PIECES];
+                    std::copy(squares, squares + _layout.count, previous);
+                    previous[j] = __builtin_ctzll(origins);
+                    const uint64_t placement = _layout.encode(previous);
+                    if (placement == TB_NO_INDEX) continue;
+                    const uint64_t predecessor = positionOf(mover, placement);
+                    if (_result[predecessor].load(std::memory_order_relaxed) != TBDraw) continue;
+
+                    if (gained == TBLoss) {
+                        if (!allMovesLose(state, predecessor)) continue;
+                        // a move out of the table may hold the loss off for longer
+                        if (_floor[predecessor] > level + 1) {
+                            schedule(predecessor, _floor[predecessor]);
+                            continue;
+                        }
+                    }
+                    uint8_t unresolved = TBDraw;
+                    if (_result[predecessor].compare_exchange_strong(unresolved, gained)) {
+                        _dtm[predecessor] = static_cast<uint8_t>(capDtm(level + 1));
+                        found.push_back(predecessor);
+                    }
+                }
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        next.insert(next.end(), found.begin(), found.end());
+    });
+}
+
+bool TableGenerator::generate() {
+    std::vector<uint64_t> frontier;
+    std::mutex            mutex;
+    parallelFor(_count, _threads, [&](const uint64_t begin, const uint64_t end) {
+        std::vector<uint64_t> mates;
+        initRange(begin, end, mates);
+        std::lock_guard<std::mutex> lock(mutex);
+        frontier.insert(frontier.end(), mates.begin(), mates.end());
+    });
+    if (!_missing.empty()) {
+        std::cerr << "chess-tb: " << _layout.signature << " needs " << _missing << " generated first" << std::endl;
+        return false;
+    }
+
+    for (int level = 0;; level++) {
+        if (level > 0 && level <= _lastScheduled) {
+            resolveScheduled(level, frontier);
+        }
+        if (frontier.empty()) {
+            if (level >= _lastScheduled) break;
+            continue;
+        }
+        _longest = level;
+
+        std::vector<uint64_t> next;
+        expand(frontier, level, next);
+        frontier.swap(next);
+    }
+    return true;
+}
+
+uint64_t TableGenerator::count(const TBResult result) const {
+    uint64_t total = 0;
+    for (const auto& value : _result) {
+        total += value.load(std::memory_order_relaxed) == result;
+    }
+    return total;
+}
+
+bool TableGenerator::write(const std::string& path) const {
+    TBHeader header{};
+    std::memcpy(header.magic, TB_MAGIC, sizeof(TB_MAGIC));
+    header.pieces    = static_cast<uint8_t>(_layout.count);
+    header.pawns     = _layout.pawns ? 1 : 0;
+    header.dtm       = _layout.count <= TB_MAX_DTM_PIECES ? 1 : 0;
+    header.positions = _layout.positions;
+
+    std::vector<unsigned char> wdl((_count + 3) / 4, 0);
+    std::vector<unsigned char> dtm(header.dtm ? _count : 0, 0);
+    for (uint64_t position = 0; position < _count; position++) {
+        const uint8_t result = _result[position].load(std::memory_order_relaxed);
+        wdl[position >> 2] |= static_cast<unsigned char>(result << ((position & 3) * 2));
+        if (header.dtm && (result == TBWin || result == TBLoss)) {
+            dtm[position] = _dtm[position].load(std::memory_order_relaxed);
+        }
+    }
+
+    std::ofstream out(path, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(wdl.data()), wdl.size());
+    out.write(reinterpret_cast<const char*>(dtm.data()), dtm.size());
+    return static_cast<bool>(out);
+}
+
+// Reads a written table back through the prober and checks every legal position against its moves: a win in n
+// has a move to a loss in n - 1 and none faster, a loss in n has only moves to wins, the longest in n - 1, and
+// a draw has a drawing move and no winning one. The distances are left out for tables without DTM. KPvK must
+// also agree with the KPK bitbase. Returns the mismatches.
+static uint64_t verifyTable(const TBLayout& layout, const Tablebases& tables, const int threads) {
+    const bool            kpk   = layout.signature == "KPvK";
+    const bool            exact = layout.count <= TB_MAX_DTM_PIECES;
+    std::atomic<uint64_t> mismatches{0};
+    parallelFor(2 * layout.positions, threads, [&](const uint64_t begin, const uint64_t end) {
+        GameState state;
+        uint64_t  found = 0;
+        for (uint64_t position = begin; position < end; position++) {
+            if (!setUpPosition(layout, position, state)) continue;
+            state.pushNullMove();
+            const bool illegal = state.inCheck();
+            state.popState();
+            if (illegal) continue;
+
+            TBResult result = TBInvalid;
+            int      dtm    = 0;
+            if (!tables.probeWdl(state, result, &dtm)) {
+                found++;
+                continue;
+            }
+
+            int  fastestWin  = 0;
+            int  longestLoss = 0;
+            bool draw        = false;
+            bool unknown     = false;
+
+            std::vector<BitMove> moves = state.generateAllMoves();
+            for (BitMove& move : moves) {
+                isExit(state, move);
+                state.pushMove(move);
+                TBResult   reply    = TBDraw;
+                int        replyDtm = 0;
+                const bool known    = state.pieceCount == 2 || tables.probeWdl(state, reply, &replyDtm);
+                state.popState();
+                if (!known || reply == TBInvalid) {
+                    unknown = true;
+                }
+                else if (reply == TBLoss) {
+                    fastestWin = fastestWin ? std::min(fastestWin, replyDtm + 1) : replyDtm + 1;
+                }
+                else if (reply == TBDraw) {
+                    draw = true;
+                }
+                else {
+                    longestLoss = std::max(longestLoss, replyDtm + 1);
+                }
+            }
+
+            bool good;
+            if (unknown) {
+                good = false;
+            }
+            else if (moves.empty()) {
+                good = state.inCheck() ? result == TBLoss && dtm == 0 : result == TBDraw;
+            }
+            else if (fastestWin) {
+                good = result == TBWin && (!exact || dtm == capDtm(fastestWin));
+            }
+            else if (draw) {
+                good = result == TBDraw;
+            }
+            else {
+                good = result == TBLoss && (!exact || dtm == capDtm(longestLoss));
+            }
+            if (good && kpk) {
+                // the bitbase answers for the side with the pawn, white here
+                const bool whiteToMove = position < layout.positions;
+                int        squares[TB_MAX_PIECES];
+                layout.decode(position % layout.positions, squares);
+                good = (result == (whiteToMove ? TBWin : TBLoss)) == kpkIsWin(squares[0], squares[1], squares[2], whiteToMove);
+            }
+            found += !good;
+        }
+        mismatches += found;
+    });
+    return mismatches;
+}
+
+// every side of up to `pieces` non-king pieces, in PIECE order, kings first
+static void addSides(std::vector<std::string>& sides, const std::string& side, const int from, const int left) {
+    static const char* pieces = "QRBNP";
+    sides.push_back(side);
+    for (int i = from; left > 0 && i < 5; i++) {
+        addSides(sides, side + pieces[i], i, left - 1);
+    }
+}
+
+static std::vector<std::string> allSignatures(const int pieces) {
+    std::vector<std::string> sides;
+    addSides(sides, "K", 0, pieces - 2);
+    std::set<std::string> signatures;
+    for (const std::string& first : sides) {
+        for (const std::string& second : sides) {
+            const size_t count = first.size() + second.size();
+            if (count >= 3 && count <= static_cast<size_t>(pieces)) {
+                signatures.insert(tablebaseSignature(first, second));
+            }
+        }
+    }
+    return std::vector<std::string>(signatures.begin(), signatures.end());
+}
+
+int main(int argc, char** argv) {
+    GeneratorOptions options;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg     = argv[i];
+        const bool        hasNext = i + 1 < argc;
+        if (arg == "--threads" && hasNext) {
+            options.threads = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--all" && hasNext) {
+            options.all = std::clamp(std::atoi(argv[++i]), 3, TB_MAX_PIECES);
+        }
+        else if (arg == "--verify") {
+            options.verify = true;
+        }
+        else if (arg == "-o" && hasNext) {
+            options.output = argv[++i];
+        }
+        else if (!arg.empty() && arg[0] == '-') {
+            usage();
+        }
+        else {
+            options.signatures.push_back(arg);
+        }
+    }
+    if (options.all) {
+        const std::vector<std::string> all = allSignatures(options.all);
+        options.signatures.insert(options.signatures.end(), all.begin(), all.end());
+    }
+    if (options.signatures.empty()) {
+        usage();
+    }
+
+    // smaller tables first, and within a size fewer pawns first, since promotions keep the piece count
+    std::vector<TBLayout> layouts;
+    for (const std::string& signature : options.signatures) {
+        TBLayout layout;
+        if (!TBLayout::fromSignature(signature, layout)) {
+            std::cerr << "chess-tb: " << signature << " isn't a signature of at most " << TB_MAX_PIECES << " pieces" << std::endl;
+            return 1;
+        }
+        layouts.push_back(layout);
+    }
+    const auto pawnCount = [](const TBLayout& layout) {
+        return std::count_if(layout.pieces, layout.pieces + layout.count, [](char piece) { return piece == 'P' || piece == 'p'; });
+    };
+    std::stable_sort(layouts.begin(), layouts.end(), [&](const TBLayout& a, const TBLayout& b) {
+        return a.count != b.count ? a.count < b.count : pawnCount(a) < pawnCount(b);
+    });
+
+    std::error_code error;
+    std::filesystem::create_directories(options.output, error);
+
+    // the first init builds the shared move generation tables, do it before the threads start
+    GameState warmup;
+    warmup.init(START_STATE, WHITE);
+
+    for (const TBLayout& layout : layouts) {
+        const std::string path = (std::filesystem::path(options.output) / (layout.signature + TB_EXTENSION)).string();
+        if (options.all && std::filesystem::exists(path, error)) {
+            std::cout << "chess-tb: keeping " << path << std::endl;
+            continue;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        Tablebases smaller;
+        smaller.load(options.output);
+        TableGenerator generator(layout, smaller, options.threads);
+        if (!generator.generate()) {
+            return 1;
+        }
+        if (!generator.write(path)) {
+            std::cerr << "chess-tb: can't write " << path << std::endl;
+            return 1;
+        }
+
+        const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        std::cout << "chess-tb: " << layout.signature << " " << generator.count(TBWin) << " wins, " << generator.count(TBDraw)
+            << " draws, " << generator.count(TBLoss) << " losses, longest mate " << generator.longestMate() << " plies in "
+            << elapsed.count() << " ms" << std::endl;
+    }
+
+    if (options.verify) {
+        Tablebases written;
+        written.load(options.output);
+        for (const TBLayout& layout : layouts) {
+            const uint64_t mismatches = verifyTable(layout, written, options.threads);
+            std::cout << "chess-tb: verified " << layout.signature << ", " << mismatches << " mismatches" << std::endl;
+            if (mismatches) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,663 @@
+//
+// chess-uci: the engine behind the Universal Chess Interface, for match managers and GUIs on headless machines.
+//
+//   chess-uci
+//
+// Commands are read from stdin on the main thread while the search runs on a thread of its own, so stop,
+// isready and quit are answered as it thinks. Supported: uci, isready, ucinewgame, setoption (Hash, Threads,
+// MultiPV, Ponder, EvalFile, TablebasePath), position startpos|fen ... [moves ...], go (depth, nodes, movetime, wtime,
+// btime, winc, binc, movestogo, infinite, ponder), ponderhit, stop, quit, bench, perft and nnuecheck.
+//
+//   chess-uci bench [depth] [hash MB] [threads] [perf]
+//
+// searches a fixed set of positions to a fixed depth and exits. The total node count is the bench signature:
+// single threaded it only changes when what the search does changes, while NPS and time show its speed. The
+// search uses the classical evaluation and no tablebases, so the signature doesn't depend on what is in
+// resources. It ends with the evaluations per second of the classical evaluation and of NNUE, with a random
+// network if none is loaded.
+//
+//   chess-uci nnuecheck
+//
+// plays random lines from the bench positions with a random network and compares every incrementally updated,
+// SIMD evaluation with one from scratch by the scalar kernels; exits with 1 if any differ.
+//
+//   chess-uci perft <depth> [perf]
+//
+// counts the leaves of the move tree of the current position, the start position from the command line, by
+// move. The generator has no castling, en passant or under-promotions, so the counts are this engine's only.
+//
+// With perf, both read the Linux hardware counters around every position and in total, and report IPC and
+// cache, branch and TLB misses per node, to tell a cache-bound change from one that runs more instructions.
+//
+#include "classes/GameState.h"
+#include "classes/Search.h"
+#include "classes/PerfCounters.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+static const char* START_STATE = "RNBQKBNRPPPPPPPP00000000000000000000000000000000pppppppprnbqkbnr";
+
+constexpr int         DEFAULT_HASH_MB        = 16;
+constexpr int         MAX_HASH_MB            = 4096;
+constexpr int         MAX_THREADS            = 256;
+constexpr int         MAX_MULTI_PV           = 64;
+constexpr const char* DEFAULT_EVAL_FILE      = "resources/chess.nnue";
+constexpr const char* DEFAULT_TABLEBASE_PATH = "resources/tablebases";
+constexpr int         DEFAULT_BENCH_DEPTH    = 6;
+constexpr int64_t     EVAL_BENCH_MS          = 250;
+constexpr uint64_t    NNUE_CHECK_SEED        = 1;
+constexpr int         NNUE_CHECK_PLIES       = 40;
+
+// openings, middlegames and endgames, quiet and tactical; castling and en passant rights are ignored
+static const char* BENCH_POSITIONS[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 10",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 11",
+    "4rrk1/pp1n3p/3q2pQ/2p1pb2/2PP4/2P3N1/P2B2PP/4RRK1 b - - 7 19",
+    "rq3rk1/ppp2ppp/1bnpb3/3N2B1/3NP3/7P/PPPQ1PP1/2KR3R w - - 7 14",
+    "r1bq1r1k/1pp1n1pp/1p1p4/4p2Q/4Pp2/1BNP4/PPP2PPP/3R1RK1 w - - 2 14",
+    "r3r1k1/2p2ppp/p1p1bn2/8/1q2P3/2NPQN2/PPP3PP/R4RK1 b - - 2 15",
+    "r1bbk1nr/pp3p1p/2n5/1N4p1/2Np1B2/8/PPP2PPP/2KR1B1R w kq - 0 13",
+    "r1bq1rk1/ppp1nppp/4n3/3p3Q/3P4/1BP1B3/PP1N2PP/R4RK1 w - - 1 16",
+    "4r1k1/r1q2ppp/ppp2n2/4P3/5Rb1/1N1BQ3/PPP3PP/R5K1 w - - 1 17",
+    "2rqkb1r/ppp2p2/2npb1p1/1N1Nn2p/2P1PP2/8/PP2B1PP/R1BQK2R b KQ - 0 11",
+    "r1bq1r1k/b1p1npp1/p2p3p/1p6/3PP3/1B2NN2/PP3PPP/R2Q1RK1 w - - 1 16",
+    "3r1rk1/p5pp/bpp1pp2/8/q1PP1P2/b3P3/P2NQRPP/1R2B1K1 b - - 6 22",
+    "r1q2rk1/2p1bppp/2Pp4/p6b/Q1PNp3/4B3/PP1R1PPP/2K4R w - - 2 18",
+    "4k2r/1pb2ppp/1p2p3/1R1p4/3P4/2r1PN2/P4PPP/1R4K1 b - - 3 22",
+    "3q2k1/pb3p1p/4pbp1/2r5/PpN2N2/1P2P2P/5PP1/Q2R2K1 b - - 4 26",
+    "6k1/6p1/6Pp/ppp5/3pn2P/1P3K2/1PP2P2/3N4 b - - 0 1",
+    "3b4/5kp1/1p1p1p1p/pP1PpP1P/P1P1P3/3KN3/8/8 w - - 0 1",
+    "2K5/p7/7P/5pR1/8/5k2/r7/8 w - - 0 1",
+    "8/6pk/1p6/8/PP3p1p/5P2/4KP1q/3Q4 w - - 0 1",
+    "7k/3p2pp/4q3/8/4Q3/5Kp1/P6b/8 w - - 0 1",
+    "8/2p5/8/2kPKp1p/2p4P/2P5/3P4/8 w - - 0 1",
+    "8/1p3pp1/7p/5P1P/2k3P1/8/2K2P2/8 w - - 0 1",
+    "8/pp2r1k1/2p1p3/3pP2p/1P1P1P1P/P5KR/8/8 w - - 0 1",
+    "8/3p4/p1bk3p/Pp6/1Kp1PpPp/2P2P1P/2P5/5B2 b - - 0 1",
+    "5k2/7R/4P2p/5K2/p1r2P1p/8/8/8 b - - 0 1",
+    "6k1/6p1/P6p/r1N5/5p2/7P/1b3PP1/4R1K1 w - - 0 1",
+    "1r3k2/4q3/2Pp3b/3Bp3/2Q2p2/1p1P2P1/1P2KP2/3N4 w - - 0 1",
+    "6k1/4pp1p/3p2p1/P1pPb3/R7/1r2P1PP/3B1P2/6K1 w - - 0 1",
+    "8/3p3B/5p2/5P2/p7/PP5b/k7/6K1 w - - 0 1",
+    "5rk1/q6p/2p3bR/1pPp1rP1/1P1Pp3/P3B1Q1/1K3P2/R7 w - - 93 90",
+    "4rrk1/1p1nq3/p7/2p1P1pp/3P2bp/3Q1Bn1/PPPB4/1K2R1NR w - - 40 21",
+    "r3k2r/3nnpbp/q2pp1p1/p7/Pp1PPPP1/4BNN1/1P5P/R2Q1RK1 w kq - 0 16",
+    "3Qb1k1/1r2ppb1/pN1n2q1/Pp1Pp1Pr/4P2p/4BP2/4B1R1/1R5K b - - 11 40",
+    "4k3/3q1r2/1N2r1b1/3ppN2/2nPP3/1B1R2n1/2R1Q3/3K4 w - - 5 1",
+    "8/8/8/8/5kp1/P7/8/1K1N4 w - - 0 1",
+    "8/8/8/5N2/8/p7/8/2NK3k w - - 0 1",
+    "8/3k4/8/8/8/4B3/4KB2/2B5 w - - 0 1",
+    "8/8/1P6/5pr1/8/4R3/7k/2K5 w - - 0 1",
+    "8/2p4P/8/kr6/6R1/8/8/1K6 w - - 0 1",
+    "8/8/3P3k/8/1p6/8/1P6/1K3n2 b - - 0 1",
+    "8/R7/2q5/8/6k1/8/1P5p/K6R w - - 0 124",
+    "6k1/3b3r/1p1p4/p1n2p2/1PPNpP1q/P3Q1p1/1R1RB1P1/5K2 b - - 0 1",
+    "r2r1n2/pp2bk2/2p1p2p/3q4/3PN1QP/2P3R1/P4PP1/5RK1 w - - 0 1",
+    "r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4",
+    "rnbqkb1r/pp2pppp/3p1n2/8/3NP3/8/PPP2PPP/RNBQKB1R w KQkq - 1 5",
+    "rnbqk2r/ppp1bppp/4pn2/3p4/2PP4/2N2N2/PP2PPPP/R1BQKB1R w KQkq - 4 5",
+    "r1bqk2r/pppp1ppp/2n2n2/2b1p3/2B1P3/2P2N2/PP1P1PPP/RNBQK2R w KQkq - 1 5",
+    "8/k7/3p4/p2P1p2/P2P1P2/8/8/K7 w - - 0 1",
+    "r1bq1rk1/pp2bppp/2n1pn2/3p4/2PP4/2N1PN2/PP1B1PPP/R2QKB1R w KQ - 1 8",
+};
+
+class UciEngine {
+public:
+    UciEngine();
+
+    // reads commands until quit or the end of input
+    void run();
+    // bench [depth] [hash MB] [threads] [perf], the options, hash table, network and tablebases used before are
+    // restored after
+    void bench(std::istringstream& input);
+    // perft <depth> [perf]
+    void perft(std::istringstream& input);
+    // true if every NNUE evaluation matched the scalar reference
+    bool nnueCheck();
+
+private:
+    void uci();
+    void setOption(std::istringstream& input);
+    void position(std::istringstream& input);
+    void go(std::istringstream& input);
+    // the move pondered on was played, the search carries on with the clock running
+    void ponderhit();
+    // ends the search if one is running, after it has sent its bestmove
+    void stopSearch();
+
+    void loadNetwork(const std::string& path);
+    void loadTablebases(const std::string& path);
+    void play(const BitMove& move);
+    void report(const SearchInfo& info);
+    // opens the counters if asked, saying so when the machine has none
+    bool openCounters(PerfCounters& counters, bool wanted);
+
+    // the search thread and the command thread both write to stdout, a line at a time
+    void send(const std::string& line);
+
+    Search                      _search;
+    NnueNetwork                 _network;
+    std::unique_ptr<Tablebases> _tablebases;
+    int                         _hashMb = DEFAULT_HASH_MB;
+    GameState                   _state;
+    // hashes of the positions before the current one since the last capture or pawn move
+    std::vector<uint64_t>       _history;
+    std::thread                 _searchThread;
+    std::mutex                  _outputMutex;
+    std::mutex                  _stopMutex;
+    std::condition_variable     _stopSignal;
+    // guarded by _stopMutex
+    bool                        _stopRequested = false; // by stop or quit
+    bool                        _ponderhit     = false;
+};
+
+UciEngine::UciEngine() {
+    _state.init(START_STATE, WHITE);
+    _search.tt().resize(DEFAULT_HASH_MB);
+    _search.setInfoCallback([this](const SearchInfo& info) { report(info); });
+    loadNetwork(DEFAULT_EVAL_FILE);
+    loadTablebases(DEFAULT_TABLEBASE_PATH);
+}
+
+void UciEngine::send(const std::string& line) {
+    std::lock_guard<std::mutex> lock(_outputMutex);
+    std::cout << line << std::endl;
+}
+
+// Library code reports load errors on stderr; what the engine ends up using goes to the GUI as info strings.
+void UciEngine::loadNetwork(const std::string& path) {
+    // a missing or bad file leaves the classical evaluation in charge
+    const bool loaded = _network.load(path);
+    _search.setNetwork(loaded ? &_network : nullptr);
+    send(loaded ? "info string NNUE evaluation using " + path : "info string classical evaluation, no network at " + path);
+}
+
+void UciEngine::loadTablebases(const std::string& path) {
+    // the search keeps a pointer to the old tables until it's given the new ones
+    auto tablebases = std::make_unique<Tablebases>();
+    const int loaded = tablebases->load(path);
+    _search.setTablebases(loaded > 0 ? tablebases.get() : nullptr);
+    if (loaded > 0) {
+        send("info string " + std::to_string(loaded) + " tablebases up to " + std::to_string(tablebases->maxPieces()) +
+             " pieces from " + path);
+    }
+    _tablebases = std::move(tablebases);
+}
+
+void UciEngine::uci() {
+    send("id name chess-uci");
+    send("id author the chess-uci authors");
+    send("option name Hash type spin default " + std::to_string(DEFAULT_HASH_MB) + " min 1 max " +
+         std::to_string(MAX_HASH_MB));
+    send("option name Threads type spin default 1 min 1 max " + std::to_string(MAX_THREADS));
+    send("option name MultiPV type spin default 1 min 1 max " + std::to_string(MAX_MULTI_PV));
+    // the GUI decides when to ponder, the option only tells it the engine can
+    send("option name Ponder type check default false");
+    send(std::string("option name EvalFile type string default ") + DEFAULT_EVAL_FILE);
+    send(std::string("option name TablebasePath type string default ") + DEFAULT_TABLEBASE_PATH);
+    send("uciok");
+}
+
+// setoption name <name> [value <value>], names and values may contain spaces
+void UciEngine::setOption(std::istringstream& input) {
+    std::string token;
+    std::string name;
+    std::string value;
+    input >> token; // "name"
+    while (input >> token && token != "value") {
+        name += (name.empty() ? "" : " ") + token;
+    }
+    while (input >> token) {
+        value += (value.empty() ? "" : " ") + token;
+    }
+
+    if (name == "Hash") {
+        _hashMb = std::clamp(std::atoi(value.c_str()), 1, MAX_HASH_MB);
+        _search.tt().resize(_hashMb);
+    }
+    else if (name == "Threads") {
+        _search.setThreads(std::clamp(std::atoi(value.c_str()), 1, MAX_THREADS));
+    }
+    else if (name == "MultiPV") {
+        _search.setMultiPv(std::clamp(std::atoi(value.c_str()), 1, MAX_MULTI_PV));
+    }
+    else if (name == "Ponder") {
+    }
+    else if (name == "EvalFile") {
+        loadNetwork(value);
+    }
+    else if (name == "TablebasePath") {
+        loadTablebases(value);
+    }
+    else {
+        send("info string unknown option " + name);
+    }
+}
+
+// GameState's stack is only as deep as a search, so a game is replayed by re-initialising after every move
+// and carrying the repetition history over
+void UciEngine::play(const BitMove& move) {
+    _history.push_back(_state.hash);
+    _state.pushMove(move);
+    if (_state.halfmoveClock == 0) {
+        _history.clear();
+    }
+    char      board[64];
+    const int halfmoves = _state.halfmoveClock;
+    std::memcpy(board, _state.state, sizeof(board));
+    _state.init(board, _state.color);
+    _state.setGameHistory(_history, halfmoves);
+}
+
+// position startpos|fen <fen> [moves <move>...]
+void UciEngine::position(std::istringstream& input) {
+    std::string token;
+    input >> token;
+    if (token == "startpos") {
+        _state.init(START_STATE, WHITE);
+        input >> token; // "moves", if any
+    }
+    else if (token == "fen") {
+        std::string fen;
+        while (input >> token && token != "moves") {
+            fen += token + " ";
+        }
+        if (!_state.initFen(fen)) {
+            send("info string bad fen " + fen);
+            _state.init(START_STATE, WHITE);
+        }
+    }
+    else {
+        return;
+    }
+    _history.clear();
+
+    while (input >> token) {
+        BitMove move;
+        if (!_state.moveFromUci(token, move)) {
+            send("info string illegal move " + token);
+            return;
+        }
+        play(move);
+    }
+}
+
+void UciEngine::report(const SearchInfo& info) {
+    std::ostringstream line;
+    line << "info depth " << info.depth << " seldepth " << info.selDepth << " multipv " << info.multiPv << " score ";
+    if (std::abs(info.score) >= SCORE_MATE_BOUND) {
+        // in moves, not plies, negative when the engine is being mated
+        const int plies = SCORE_MATE - std::abs(info.score);
+        line << "mate " << (info.score > 0 ? (plies + 1) / 2 : -(plies / 2));
+    }
+    else {
+        line << "cp " << info.score;
+    }
+    line << " nodes " << info.nodes << " nps " << info.nodes * 1000 / std::max<int64_t>(1, info.time) << " hashfull "
+         << info.hashfull << " time " << info.time << " pv";
+    for (const BitMove& move : info.pv) {
+        line << " " << GameState::moveToUci(move);
+    }
+    send(line.str());
+}
+
+// go [depth n] [nodes n] [movetime ms] [wtime ms] [btime ms] [winc ms] [binc ms] [movestogo n] [infinite] [ponder]
+void UciEngine::go(std::istringstream& input) {
+    stopSearch();
+
+    SearchLimits limits;
+    std::string  token;
+    while (input >> token) {
+        if (token == "depth") input >> limits.depth;
+        else if (token == "nodes") input >> limits.nodes;
+        else if (token == "movetime") input >> limits.moveTime;
+        else if (token == "wtime") input >> limits.time[0];
+        else if (token == "btime") input >> limits.time[1];
+        else if (token == "winc") input >> limits.increment[0];
+        else if (token == "binc") input >> limits.increment[1];
+        else if (token == "movestogo") input >> limits.movesToGo;
+        else if (token == "infinite") limits.infinite = true;
+        else if (token == "ponder") limits.ponder = true;
+    }
+
+    _search.resetStop();
+    {
+        std::lock_guard<std::mutex> lock(_stopMutex);
+        _stopRequested = false;
+        _ponderhit     = false;
+    }
+    _searchThread = std::thread([this, limits, state = std::make_unique<GameState>(_state)]() {
+        BitMove best;
+        const bool found = _search.think(*state, limits, best);
+        // infinite and ponder searches only answer once they're told to stop, or for a ponder search that its
+        // move was played, even if they ran out of depth first
+        if (limits.infinite || limits.ponder) {
+            std::unique_lock<std::mutex> lock(_stopMutex);
+            _stopSignal.wait(lock, [&] { return _stopRequested || (_ponderhit && !limits.infinite); });
+        }
+        if (!found) {
+            send("bestmove 0000");
+            return;
+        }
+        // one JSON line per search, for comparing builds
+        send("info string stats " + _search.stats().toJson());
+        const std::vector<BitMove>& pv = _search.pv();
+        std::string bestmove = "bestmove " + GameState::moveToUci(best);
+        if (pv.size() >= 2 && pv[0] == best) {
+            bestmove += " ponder " + GameState::moveToUci(pv[1]);
+        }
+        send(bestmove);
+    });
+}
+
+void UciEngine::ponderhit() {
+    _search.ponderhit();
+    {
+        std::lock_guard<std::mutex> lock(_stopMutex);
+        _ponderhit = true;
+    }
+    _stopSignal.notify_all();
+}
+
+void UciEngine::stopSearch() {
+    _search.stop();
+    {
+        std::lock_guard<std::mutex> lock(_stopMutex);
+        _stopRequested = true;
+    }
+    _stopSignal.notify_all();
+    if (_searchThread.joinable()) {
+        _searchThread.join();
+    }
+}
+
+// the numbers of a bench or perft command in order, and whether "perf" asked for the hardware counters
+static std::vector<int> benchArguments(std::istringstream& input, bool& counters) {
+    std::vector<int> numbers;
+    std::string      token;
+    counters = false;
+    while (input >> token) {
+        if (token == "perf") {
+            counters = true;
+        }
+        else {
+            numbers.push_back(std::atoi(token.c_str()));
+        }
+    }
+    return numbers;
+}
+
+bool UciEngine::openCounters(PerfCounters& counters, const bool wanted) {
+    if (!wanted) {
+        return false;
+    }
+    if (!counters.open()) {
+        send("info string no hardware counters (not Linux, or perf_event_paranoid too high)");
+        return false;
+    }
+    return true;
+}
+
+// Evaluations per second of evaluate(state) over every legal move of every bench position, each made, evaluated
+// and taken back, so NNUE pays for its accumulator updates the way it does in a search.
+template <typename Evaluate>
+static uint64_t evalsPerSecond(Evaluate&& evaluate) {
+    std::vector<std::unique_ptr<GameState>> states;
+    for (const char* fen : BENCH_POSITIONS) {
+        states.push_back(std::make_unique<GameState>());
+        states.back()->initFen(fen);
+    }
+
+    uint64_t   evals = 0;
+    int64_t    sum   = 0;
+    const auto start = std::chrono::steady_clock::now();
+    int64_t    time  = 0;
+    while (time < EVAL_BENCH_MS) {
+        for (auto& state : states) {
+            for (const BitMove& move : state->generateAllMoves()) {
+                state->pushMove(move);
+                sum += evaluate(*state);
+                state->popState();
+                evals++;
+            }
+        }
+        time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+    // keeps the evaluations from being optimized away
+    return sum == INT64_MIN ? 0 : evals * 1000 / time;
+}
+
+void UciEngine::bench(std::istringstream& input) {
+    stopSearch();
+
+    bool                   useCounters = false;
+    const std::vector<int> numbers     = benchArguments(input, useCounters);
+    const int depth   = std::clamp(numbers.size() > 0 ? numbers[0] : DEFAULT_BENCH_DEPTH, 1, MAX_DEPTH - 1);
+    const int hashMb  = std::clamp(numbers.size() > 1 ? numbers[1] : DEFAULT_HASH_MB, 1, MAX_HASH_MB);
+    const int threads = std::clamp(numbers.size() > 2 ? numbers[2] : 1, 1, MAX_THREADS);
+    PerfCounters counters;
+    useCounters = openCounters(counters, useCounters);
+
+    const int          previousThreads    = _search.threads();
+    const int          previousMultiPv    = _search.multiPv();
+    const NnueNetwork* previousNetwork    = _search.network();
+    const Tablebases*  previousTablebases = _search.tablebases();
+    // the game's table waits here while the bench searches a fresh one of its own size, then is swapped back
+    TranspositionTable sessionTable;
+    sessionTable.resize(hashMb);
+    std::swap(_search.tt(), sessionTable);
+    _search.setThreads(threads);
+    _search.setMultiPv(1);
+    _search.setInfoCallback(nullptr);
+    _search.setNetwork(nullptr);
+    _search.setTablebases(nullptr);
+
+    const int  count      = static_cast<int>(std::size(BENCH_POSITIONS));
+    uint64_t   totalNodes = 0;
+    PerfSample total;
+    const auto start      = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++) {
+        GameState state;
+        state.initFen(BENCH_POSITIONS[i]);
+        BitMove best;
+        _search.resetStop();
+        if (useCounters) counters.start();
+        _search.think(state, depth, best);
+        const PerfSample sample = useCounters ? counters.stop() : PerfSample();
+        const uint64_t   nodes  = _search.stats().nodes;
+        totalNodes += nodes;
+        for (int event = 0; event < PerfEventCount; event++) {
+            total.value[event] += sample.value[event];
+            total.valid[event] = sample.valid[event];
+        }
+        send("position " + std::to_string(i + 1) + "/" + std::to_string(count) + " nodes " + std::to_string(nodes) +
+             " bestmove " + GameState::moveToUci(best) + " " + BENCH_POSITIONS[i]);
+        if (useCounters) {
+            send("  " + sample.describe(nodes));
+        }
+    }
+    const int64_t time = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+
+    send("bench depth " + std::to_string(depth) + " hash " + std::to_string(hashMb) + " threads " +
+         std::to_string(threads));
+    send("time " + std::to_string(time) + " ms");
+    send("nodes " + std::to_string(totalNodes));
+    send("nps " + std::to_string(totalNodes * 1000 / std::max<int64_t>(1, time)));
+    if (useCounters) {
+        send("counters " + total.describe(totalNodes));
+    }
+
+    // inference costs the same whatever the weights, so without a network a random one stands in
+    NnueNetwork random;
+    if (!_network.loaded()) {
+        random.randomize(NNUE_CHECK_SEED);
+    }
+    PawnTable      pawnTable;
+    auto           evaluator = std::make_unique<NnueEvaluator>(_network.loaded() ? _network : random);
+    const uint64_t classical = evalsPerSecond([&](GameState& state) { return evaluateBoard(state, pawnTable); });
+    const uint64_t nnue      = evalsPerSecond([&](const GameState& state) { return evaluator->evaluate(state); });
+    send("eval classical " + std::to_string(classical) + "/s nnue " + std::to_string(nnue) + "/s " +
+         NnueEvaluator::kernels() + (_network.loaded() ? "" : " (random network)"));
+
+    std::swap(_search.tt(), sessionTable);
+    _search.setThreads(previousThreads);
+    _search.setMultiPv(previousMultiPv);
+    _search.setNetwork(previousNetwork);
+    _search.setTablebases(previousTablebases);
+    _search.setInfoCallback([this](const SearchInfo& info) { report(info); });
+}
+
+static uint64_t countLeaves(GameState& state, const int depth) {
+    std::vector<BitMove> moves = state.generateAllMoves();
+    if (depth <= 1) {
+        return moves.size();
+    }
+    uint64_t leaves = 0;
+    for (const BitMove& move : moves) {
+        state.pushMove(move);
+        leaves += countLeaves(state, depth - 1);
+        state.popState();
+    }
+    return leaves;
+}
+
+void UciEngine::perft(std::istringstream& input) {
+    stopSearch();
+
+    bool                   useCounters = false;
+    const std::vector<int> numbers     = benchArguments(input, useCounters);
+    // the state's stack is as deep as a search
+    const int depth = std::clamp(numbers.empty() ? 1 : numbers[0], 1, MAX_DEPTH - 2);
+    PerfCounters counters;
+    useCounters = openCounters(counters, useCounters);
+
+    // a copy, so the position is left as it was
+    auto       state = std::make_unique<GameState>(_state);
+    uint64_t   total = 0;
+    const auto start = std::chrono::steady_clock::now();
+    if (useCounters) counters.start();
+    for (const BitMove& move : state->generateAllMoves()) {
+        uint64_t leaves = 1;
+        if (depth > 1) {
+            state->pushMove(move);
+            leaves = countLeaves(*state, depth - 1);
+            state->popState();
+        }
+        total += leaves;
+        send(GameState::moveToUci(move) + ": " + std::to_string(leaves));
+    }
+    const PerfSample sample = useCounters ? counters.stop() : PerfSample();
+    const int64_t    time   = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+
+    send("perft depth " + std::to_string(depth) + " nodes " + std::to_string(total) + " time " +
+         std::to_string(time) + " ms nps " + std::to_string(total * 1000 / std::max<int64_t>(1, time)));
+    if (useCounters) {
+        send("counters " + sample.describe(total));
+    }
+}
+
+bool UciEngine::nnueCheck() {
+    stopSearch();
+
+    NnueNetwork network;
+    network.randomize(NNUE_CHECK_SEED);
+    auto evaluator  = std::make_unique<NnueEvaluator>(network);
+    int  mismatches = 0;
+    for (size_t i = 0; i < std::size(BENCH_POSITIONS); i++) {
+        auto state = std::make_unique<GameState>();
+        state->initFen(BENCH_POSITIONS[i]);
+        mismatches += evaluator->check(*state, NNUE_CHECK_PLIES, NNUE_CHECK_SEED + i);
+    }
+    send(std::string("nnuecheck kernels ") + NnueEvaluator::kernels() + " mismatches " + std::to_string(mismatches));
+    return mismatches == 0;
+}
+
+void UciEngine::run() {
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        std::istringstream input(line);
+        std::string        command;
+        input >> command;
+
+        if (command == "quit") {
+            break;
+        }
+        else if (command == "stop") {
+            stopSearch();
+        }
+        else if (command == "ponderhit") {
+            ponderhit();
+        }
+        else if (command == "isready") {
+            send("readyok");
+        }
+        else if (command == "uci") {
+            uci();
+        }
+        else if (command == "go") {
+            go(input);
+        }
+        else if (command == "position") {
+            stopSearch();
+            position(input);
+        }
+        else if (command == "setoption") {
+            stopSearch();
+            setOption(input);
+        }
+        else if (command == "bench") {
+            bench(input);
+        }
+        else if (command == "perft") {
+            perft(input);
+        }
+        else if (command == "nnuecheck") {
+            nnueCheck();
+        }
+        else if (command == "ucinewgame") {
+            stopSearch();
+            _search.tt().clear();
+        }
+        else if (!command.empty()) {
+            send("info string unknown command " + command);
+        }
+    }
+    stopSearch();
+}
+
+int main(int argc, char** argv) {
+    UciEngine engine;
+    if (argc > 1 && std::string(argv[1]) == "nnuecheck") {
+        return engine.nnueCheck() ? 0 : 1;
+    }
+    if (argc > 1 && (std::string(argv[1]) == "bench" || std::string(argv[1]) == "perft")) {
+        std::string arguments;
+        for (int i = 2; i < argc; i++) {
+            arguments += std::string(argv[i]) + " ";
+        }
+        std::istringstream input(arguments);
+        if (std::string(argv[1]) == "bench") {
+            engine.bench(input);
+        }
+        else {
+            engine.perft(input);
+        }
+        return 0;
+    }
+    engine.run();
+    return 0;
+}